@@ -1,8 +1,14 @@
+#define _DEFAULT_SOURCE
+
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "cache.h"
+#include "stream.h"
+
 #define likely(x) __builtin_expect(x, 1)
 
 struct npf
@@ -18,26 +24,86 @@ struct npf_char
     uint8_t rows[];
 } __attribute__((packed));
 
+// Ab Version 3 folgen jedem Zeichen hinter den Zeilen seine Metriken
+struct npf_metrics
+{
+    uint8_t advance;
+    uint8_t ink_x, ink_y, ink_w, ink_h;
+} __attribute__((packed));
+
+// Bestimmt den tatsächlich gesetzten Bereich eines Zeichens
+static void ink_bounds(struct npf_metrics *m, const uint8_t *rows, unsigned rowsz, unsigned height)
+{
+    uint8_t cols[rowsz];
+    int top = -1, bottom = -1;
+
+    memset(cols, 0, rowsz);
+    for (unsigned y = 0; y < height; y++)
+    {
+        uint8_t any = 0;
+        for (unsigned x = 0; x < rowsz; x++)
+        {
+            cols[x] |= rows[y * rowsz + x];
+            any |= rows[y * rowsz + x];
+        }
+
+        if (any)
+        {
+            if (top < 0)
+                top = y;
+            bottom = y;
+        }
+    }
+
+    m->ink_x = m->ink_y = m->ink_w = m->ink_h = 0;
+    if (top < 0)
+        return;
+
+    unsigned first = 0, last = rowsz - 1;
+    while (!cols[first])
+        first++;
+    while (!cols[last])
+        last--;
+
+    m->ink_x = first * 8 + __builtin_ctz(cols[first]);
+    m->ink_w = last * 8 + 32 - __builtin_clz(cols[last]) - m->ink_x;
+    m->ink_y = top;
+    m->ink_h = bottom - top + 1;
+}
+
 int main(int argc, char *argv[])
 {
+    bool v2 = false;
+
+    if ((argc >= 2) && !strcmp(argv[1], "-2"))
+    {
+        v2 = true;
+        argc--;
+        argv++;
+    }
+
     if (argc < 3)
     {
-        fprintf(stderr, "Benutzung: bdf2npf <bdf> <npf>\n");
+        fprintf(stderr, "Benutzung: bdf2npf [-2] <bdf> <npf>\n");
+        fprintf(stderr, " -2: Version 2 (ohne Metriken) schreiben\n");
+        fprintf(stderr, "„-“ steht für die Standardein- bzw. -ausgabe.\n");
         return 1;
     }
 
-    FILE *bdf = fopen(argv[1], "rb");
+    struct npf_cache cache;
+    if (cache_lookup(&cache, "bdf2npf", v2 ? "-2" : "", argv[1], argv[2]))
+        return 0;
+
+    // Die BDF-Datei wird zeilenweise gelesen und jedes Zeichen sofort
+    // geschrieben, beides geht also auch mit Pipes
+    FILE *bdf = stream_open(argv[1], "rb");
     if (bdf == NULL)
-    {
-        perror(argv[1]);
         return 1;
-    }
 
-    FILE *npf = fopen(argv[2], "wb");
+    FILE *npf = stream_open(argv[2], "wb");
     if (npf == NULL)
     {
         fclose(bdf);
-        perror(argv[2]);
         return 1;
     }
 
@@ -89,11 +155,17 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    printf("Erstelle Schriftart „%s“ (%i×%i, %i Zeichen).\n", name, fw, fh, (int)chars);
+    if (!v2 && ((fw > UINT8_MAX) || (fh > UINT8_MAX)))
+    {
+        fprintf(stderr, "Zeichen sind zu groß für Metriken, schreibe Version 2.\n");
+        v2 = true;
+    }
+
+    fprintf(stream_messages(npf), "Erstelle Schriftart „%s“ (%i×%i, %i Zeichen).\n", name, fw, fh, (int)chars);
 
     struct npf npfh = {
         .sig = "NPF",
-        .version = '2',
+        .version = v2 ? '2' : '3',
         .height = fh,
         .width = fw
     };
@@ -102,10 +174,13 @@ int main(int argc, char *argv[])
 
     fwrite(&npfh, sizeof(npfh), 1, npf);
 
-    int cw = 0, ch = 0, cx = 0, cy = 0;
-    int charsz = fh * ((fw + 7) / 8);
+    int cw = 0, ch = 0, cx = 0, cy = 0, dw = fw;
+    int rowsz = (fw + 7) / 8;
+    int charsz = fh * rowsz;
+    int metricsz = v2 ? 0 : sizeof(struct npf_metrics);
 
-    struct npf_char *npfc = malloc(charsz + 4);
+    struct npf_char *npfc = malloc(charsz + metricsz + 4);
+    struct npf_metrics *npfm = (struct npf_metrics *)&npfc->rows[charsz];
 
     while (!feof(bdf))
     {
@@ -120,8 +195,12 @@ int main(int argc, char *argv[])
         if (cmd == NULL)
             continue;
 
-        if (!strcmp(cmd, "ENCODING"))
+        if (!strcmp(cmd, "STARTCHAR"))
+            dw = fw;
+        else if (!strcmp(cmd, "ENCODING"))
             npfc->num = atoi(strtok(NULL, " "));
+        else if (!strcmp(cmd, "DWIDTH"))
+            dw = atoi(strtok(NULL, " "));
         else if (!strcmp(cmd, "BBX"))
         {
             cw = atoi(strtok(NULL, " "));
@@ -132,24 +211,54 @@ int main(int argc, char *argv[])
         else if (!strcmp(cmd, "BITMAP"))
         {
             memset(npfc->rows, 0, charsz);
-            size_t bx = cx + fx;
-            size_t by = fh - (ch + cy) + fy;
+            int bx = cx - fx;
+            int by = fh - (ch + cy) + fy;
+            bool clipped = false;
 
             for (int i = 0; i < ch; i++)
             {
                 fgets(buffer, 1024, bdf);
-                unsigned num = strtol(buffer, NULL, 16);
-                for (int rx = 0; rx < cw; rx++)
+                int digits = strlen(buffer);
+
+                // Jede Zeile besteht aus (cw + 7) / 8 Bytes in Hexadezimal,
+                // das höchstwertige Bit ist das linke Pixel
+                for (int rx = 0; (rx < cw) && (rx / 4 < digits); rx++)
                 {
-                    if (num & (1 << (7 - rx)))
-                        npfc->rows[by + i] |= 1 << (bx + rx);
+                    char digit[2] = { buffer[rx / 4], 0 };
+                    if (!(strtol(digit, NULL, 16) & (8 >> (rx % 4))))
+                        continue;
+
+                    // Was über die Zelle hinausragt, würde sonst fremde Zeilen
+                    // oder gar den Code des Zeichens überschreiben
+                    int x = bx + rx, y = by + i;
+                    if ((x < 0) || (x >= fw) || (y < 0) || (y >= fh))
+                    {
+                        clipped = true;
+                        continue;
+                    }
+
+                    npfc->rows[y * rowsz + x / 8] |= 1 << (x % 8);
                 }
             }
-            fwrite(npfc, charsz + 4, 1, npf);
+
+            if (clipped)
+                fprintf(stderr, "U+%04X ragt über die Zelle hinaus und wurde abgeschnitten.\n", (unsigned)npfc->num);
+
+            if (!v2)
+            {
+                ink_bounds(npfm, npfc->rows, rowsz, fh);
+                npfm->advance = (dw < 0) ? 0 : (dw > UINT8_MAX) ? UINT8_MAX : dw;
+            }
+
+            fwrite(npfc, charsz + metricsz + 4, 1, npf);
         }
     }
 
     free(npfc);
     fclose(npf);
     fclose(bdf);
+
+    cache_store(&cache, argv[2]);
+
+    return 0;
 }
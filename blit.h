@@ -0,0 +1,152 @@
+#ifndef BLIT_H
+#define BLIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Rastert Zeichen in einen Pixelpuffer: Jedes Pixel wird zu bpp Bytes mit
+// dem Wert fg (gesetzt) bzw. bg. Für die üblichen Zellgrößen gibt es zur
+// Übersetzungszeit spezialisierte Kernel, deren Schleifen vollständig
+// ausgerollt werden; blit_select() wählt beim Laden der Schriftart den
+// passenden aus, alle anderen Größen gehen über blit_generic().
+//
+// Die Zeilen liegen wie in NPF vor: (w + 7) / 8 Bytes je Zeile, das
+// niederwertigste Bit ist das linke Pixel.
+
+typedef void blit_func(uint8_t *dst, size_t pitch, const uint8_t *rows, uint8_t fg, uint8_t bg);
+
+struct blit
+{
+    blit_func *kernel; // NULL: blit_generic()
+    unsigned width, height, bpp;
+};
+
+#define BLIT_BYTES(x) ((x) * 0x0101010101010101ULL)
+
+// Verteilt die acht Bits von b auf die acht Bytes des Ergebnisses (0x00 oder
+// 0xFF), Bit 0 ins erste Byte
+static inline uint64_t blit_expand8(uint8_t b)
+{
+    uint64_t v = BLIT_BYTES((uint64_t)b) & 0x8040201008040201ULL;
+    v = ((v + BLIT_BYTES(0x7FULL)) | v) & BLIT_BYTES(0x80ULL);
+    return (v >> 7) * 0xFF;
+}
+
+static inline void blit_generic(uint8_t *dst, size_t pitch, const uint8_t *rows,
+                                unsigned w, unsigned h, unsigned bpp, uint8_t fg, uint8_t bg)
+{
+    unsigned rowsz = (w + 7) / 8;
+
+    for (unsigned y = 0; y < h; y++)
+    {
+        uint8_t *d = dst + y * pitch;
+        for (unsigned x = 0; x < w; x++)
+        {
+            uint8_t v = (rows[y * rowsz + x / 8] & (1 << (x % 8))) ? fg : bg;
+            for (unsigned i = 0; i < bpp; i++)
+                d[x * bpp + i] = v;
+        }
+    }
+}
+
+// Die Parameter sind Konstanten, alle Bedingungen und Schleifengrenzen stehen
+// also schon beim Übersetzen fest. Bei einem Byte je Pixel und ganzen Bytes
+// je Zeile werden acht Pixel auf einmal geschrieben.
+#define BLIT_KERNEL(W, H, BPP) \
+    static void blit_##W##x##H##_##BPP(uint8_t *dst, size_t pitch, const uint8_t *rows, uint8_t fg, uint8_t bg) \
+    { \
+        _Pragma("GCC unroll 32") \
+        for (unsigned y = 0; y < (H); y++) \
+        { \
+            uint8_t *d = dst + y * pitch; \
+            if (((BPP) == 1) && !((W) % 8)) \
+            { \
+                uint64_t f = BLIT_BYTES((uint64_t)fg), b = BLIT_BYTES((uint64_t)bg); \
+                _Pragma("GCC unroll 4") \
+                for (unsigned i = 0; i < (W) / 8; i++) \
+                { \
+                    uint64_t v = b ^ ((f ^ b) & blit_expand8(rows[y * ((W) / 8) + i])); \
+                    memcpy(d + i * 8, &v, 8); \
+                } \
+            } \
+            else \
+            { \
+                _Pragma("GCC unroll 32") \
+                for (unsigned x = 0; x < (W); x++) \
+                { \
+                    uint8_t v = (rows[y * (((W) + 7) / 8) + x / 8] & (1 << (x % 8))) ? fg : bg; \
+                    memset(d + x * (BPP), v, (BPP)); \
+                } \
+            } \
+        } \
+    }
+
+BLIT_KERNEL(8, 8, 1)
+BLIT_KERNEL(8, 14, 1)
+BLIT_KERNEL(8, 16, 1)
+BLIT_KERNEL(16, 32, 1)
+BLIT_KERNEL(8, 8, 3)
+BLIT_KERNEL(8, 14, 3)
+BLIT_KERNEL(8, 16, 3)
+BLIT_KERNEL(16, 32, 3)
+
+static const struct blit blit_kernels[] = {
+    { blit_8x8_1, 8, 8, 1 },
+    { blit_8x14_1, 8, 14, 1 },
+    { blit_8x16_1, 8, 16, 1 },
+    { blit_16x32_1, 16, 32, 1 },
+    { blit_8x8_3, 8, 8, 3 },
+    { blit_8x14_3, 8, 14, 3 },
+    { blit_8x16_3, 8, 16, 3 },
+    { blit_16x32_3, 16, 32, 3 },
+};
+
+static inline struct blit blit_select(unsigned w, unsigned h, unsigned bpp)
+{
+    for (size_t i = 0; i < sizeof(blit_kernels) / sizeof(blit_kernels[0]); i++)
+        if ((blit_kernels[i].width == w) && (blit_kernels[i].height == h) && (blit_kernels[i].bpp == bpp))
+            return blit_kernels[i];
+
+    return (struct blit){ .kernel = NULL, .width = w, .height = h, .bpp = bpp };
+}
+
+static inline void blit(const struct blit *b, uint8_t *dst, size_t pitch, const uint8_t *rows, uint8_t fg, uint8_t bg)
+{
+    if (b->kernel != NULL)
+        b->kernel(dst, pitch, rows, fg, bg);
+    else
+        blit_generic(dst, pitch, rows, b->width, b->height, b->bpp, fg, bg);
+}
+
+// Zeichnet nur das Rechteck ab (x, y) mit w × h Pixeln (etwa den gesetzten
+// Bereich aus den Metriken); der Rest der Zelle muss in dst schon bg
+// enthalten. Leere Rechtecke werden übersprungen. Mit einem Kernel wird
+// trotzdem die ganze Zelle gezeichnet, das ist schneller als pixelweise.
+static inline void blit_region(const struct blit *b, uint8_t *dst, size_t pitch, const uint8_t *rows,
+                               unsigned x, unsigned y, unsigned w, unsigned h, uint8_t fg, uint8_t bg)
+{
+    if (!w || !h)
+        return;
+
+    if (b->kernel != NULL)
+    {
+        b->kernel(dst, pitch, rows, fg, bg);
+        return;
+    }
+
+    unsigned rowsz = (b->width + 7) / 8;
+
+    for (unsigned ry = y; ry < y + h; ry++)
+    {
+        uint8_t *d = dst + ry * pitch;
+        for (unsigned rx = x; rx < x + w; rx++)
+        {
+            uint8_t v = (rows[ry * rowsz + rx / 8] & (1 << (rx % 8))) ? fg : bg;
+            for (unsigned i = 0; i < b->bpp; i++)
+                d[rx * b->bpp + i] = v;
+        }
+    }
+}
+
+#endif
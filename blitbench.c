@@ -0,0 +1,101 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "blit.h"
+
+// Vergleicht die spezialisierten Kernel aus blit.h mit blit_generic(): Für
+// jede Zellgröße werden zufällige Zeichen gerastert, einmal über den Kernel,
+// einmal über den allgemeinen Pfad, und die Ergebnisse auf Gleichheit geprüft.
+
+#define GLYPHS 4096
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Damit der Übersetzer den allgemeinen Pfad nicht doch für die Konstanten
+// der Tabelle spezialisiert
+static volatile unsigned opaque_one = 1;
+
+static double run(const struct blit *b, uint8_t *dst, size_t pitch, const uint8_t *glyphs, size_t glyphsz, unsigned rounds)
+{
+    double start = now();
+
+    for (unsigned r = 0; r < rounds; r++)
+        for (unsigned g = 0; g < GLYPHS; g++)
+            blit(b, dst + (g % 16) * b->width * b->bpp, pitch, glyphs + g * glyphsz, 0x00, 0xFF);
+
+    return (now() - start) * 1e9 / ((double)rounds * GLYPHS);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned rounds = 200;
+
+    if (argc > 1)
+    {
+        char *tmp;
+        rounds = strtoul(argv[1], &tmp, 0);
+        if (*tmp || !rounds)
+        {
+            fprintf(stderr, "Benutzung: blitbench [Durchläufe]\n");
+            return 1;
+        }
+    }
+
+    static const unsigned sizes[][2] = { { 8, 8 }, { 8, 14 }, { 8, 16 }, { 16, 32 } };
+
+    srand(1);
+
+    printf("Zelle  Bytes/Pixel  allgemein    Kernel  Faktor\n");
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        for (unsigned bpp = 1; bpp <= 3; bpp += 2)
+        {
+            unsigned w = sizes[s][0], h = sizes[s][1];
+            size_t glyphsz = (size_t)h * ((w + 7) / 8);
+
+            uint8_t *glyphs = malloc(GLYPHS * glyphsz);
+            for (size_t i = 0; i < GLYPHS * glyphsz; i++)
+                glyphs[i] = rand();
+
+            // Wie in npf2bmp: eine Zeile mit 16 Zeichen nebeneinander
+            size_t pitch = 16 * w * bpp;
+            uint8_t *ref = calloc(pitch, h), *out = calloc(pitch, h);
+
+            struct blit fast = blit_select(w, h, bpp);
+            struct blit slow = { .kernel = NULL, .width = w * opaque_one, .height = h * opaque_one, .bpp = bpp * opaque_one };
+
+            for (unsigned g = 0; g < GLYPHS; g++)
+            {
+                blit(&slow, ref, pitch, glyphs + g * glyphsz, 0x00, 0xFF);
+                blit(&fast, out, pitch, glyphs + g * glyphsz, 0x00, 0xFF);
+                if (memcmp(ref, out, pitch * h))
+                {
+                    fprintf(stderr, "%u×%u (%u Bytes/Pixel): Kernel weicht bei Zeichen %u ab.\n", w, h, bpp, g);
+                    return 1;
+                }
+            }
+
+            double t_slow = run(&slow, ref, pitch, glyphs, glyphsz, rounds);
+            double t_fast = run(&fast, out, pitch, glyphs, glyphsz, rounds);
+
+            printf("%2u×%-2u  %11u  %6.1f ns  %5.1f ns  %5.1f×\n", w, h, bpp, t_slow, t_fast, t_slow / t_fast);
+
+            free(out);
+            free(ref);
+            free(glyphs);
+        }
+    }
+
+    return 0;
+}
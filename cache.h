@@ -0,0 +1,306 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+// Inhaltsadressierter Zwischenspeicher für Konvertierungen. Ist die
+// Umgebungsvariable NPF_CACHE gesetzt, wird die Ausgabe unter einem Schlüssel
+// aus Werkzeug, Optionen und dem Inhalt der Eingabe (XXH64) in diesem
+// Verzeichnis abgelegt; ein Treffer wird per Reflink, harter Verknüpfung
+// oder notfalls als Kopie übernommen, statt neu zu konvertieren.
+// Benötigt _DEFAULT_SOURCE (für flock()).
+//
+// Einträge sind schreibgeschützt, damit eine hart verknüpfte Ausgabe nicht
+// versehentlich den Cache verändert; die Werkzeuge löschen ihre Ausgabe vor
+// dem Schreiben.
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <linux/fs.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Einträge werden ungültig, sobald das Werkzeug neu übersetzt wird
+#define CACHE_BUILD __DATE__ " " __TIME__
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+struct npf_cache
+{
+    bool enabled;
+    const char *dir;
+    char entry[PATH_MAX];
+};
+
+static inline uint64_t xxh64_rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t xxh64_read64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t input)
+{
+    acc += input * XXH_PRIME64_2;
+    return xxh64_rotl(acc, 31) * XXH_PRIME64_1;
+}
+
+static inline uint64_t xxh64_merge(uint64_t acc, uint64_t val)
+{
+    acc ^= xxh64_round(0, val);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+static inline uint64_t xxh64(const void *data, size_t len, uint64_t seed)
+{
+    const uint8_t *p = data, *end = p + len;
+    uint64_t h;
+
+    if (len >= 32)
+    {
+        uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64_t v2 = seed + XXH_PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_PRIME64_1;
+
+        do
+        {
+            v1 = xxh64_round(v1, xxh64_read64(p));
+            v2 = xxh64_round(v2, xxh64_read64(p + 8));
+            v3 = xxh64_round(v3, xxh64_read64(p + 16));
+            v4 = xxh64_round(v4, xxh64_read64(p + 24));
+            p += 32;
+        }
+        while (end - p >= 32);
+
+        h = xxh64_rotl(v1, 1) + xxh64_rotl(v2, 7) + xxh64_rotl(v3, 12) + xxh64_rotl(v4, 18);
+        h = xxh64_merge(h, v1);
+        h = xxh64_merge(h, v2);
+        h = xxh64_merge(h, v3);
+        h = xxh64_merge(h, v4);
+    }
+    else
+        h = seed + XXH_PRIME64_5;
+
+    h += len;
+
+    for (; end - p >= 8; p += 8)
+        h = xxh64_rotl(h ^ xxh64_round(0, xxh64_read64(p)), 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+
+    if (end - p >= 4)
+    {
+        uint32_t k;
+        memcpy(&k, p, sizeof(k));
+        h = xxh64_rotl(h ^ (k * XXH_PRIME64_1), 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+
+    for (; p < end; p++)
+        h = xxh64_rotl(h ^ (*p * XXH_PRIME64_5), 11) * XXH_PRIME64_1;
+
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+// Überträgt den Inhalt von src nach dst (als Reflink, sofern das Dateisystem
+// es unterstützt)
+static inline bool cache_copy(int src, int dst)
+{
+    if (!ioctl(dst, FICLONE, src))
+        return true;
+
+    char buf[65536];
+    ssize_t rd;
+    while ((rd = read(src, buf, sizeof(buf))) > 0)
+    {
+        for (ssize_t wr = 0; wr < rd;)
+        {
+            ssize_t w = write(dst, buf + wr, rd - wr);
+            if (w <= 0)
+                return false;
+            wr += w;
+        }
+    }
+
+    return !rd;
+}
+
+// Zählt einen Treffer oder Fehlschlag in <dir>/stats (unter einer Sperre,
+// damit parallele Builds sich nicht in die Quere kommen) und gibt die
+// Summen aus
+static inline void cache_count(const struct npf_cache *c, bool hit)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/stats", c->dir);
+
+    int fd = open(path, O_RDWR | O_CREAT, 0666);
+    if (fd < 0)
+        return;
+
+    flock(fd, LOCK_EX);
+
+    char buf[64] = { 0 };
+    unsigned long hits = 0, misses = 0;
+    if (pread(fd, buf, sizeof(buf) - 1, 0) > 0)
+        sscanf(buf, "%lu %lu", &hits, &misses);
+
+    if (hit)
+        hits++;
+    else
+        misses++;
+
+    int len = snprintf(buf, sizeof(buf), "%lu %lu\n", hits, misses);
+    if (ftruncate(fd, 0) || (pwrite(fd, buf, len, 0) != len))
+        fprintf(stderr, "%s: Statistik konnte nicht geschrieben werden.\n", path);
+
+    close(fd);
+
+    fprintf(stderr, "Cache: %s (bisher %lu Treffer, %lu Fehlschläge).\n", hit ? "Treffer" : "Fehlschlag", hits, misses);
+}
+
+// Sucht die Ausgabe für input (mit den angegebenen Optionen) im Cache. Bei
+// einem Treffer liegt sie danach unter output und es wird true
+// zurückgegeben; andernfalls muss konvertiert und danach cache_store()
+// aufgerufen werden.
+static inline bool cache_lookup(struct npf_cache *c, const char *tool, const char *options,
+                                const char *input, const char *output)
+{
+    c->enabled = false;
+    c->dir = getenv("NPF_CACHE");
+    if ((c->dir == NULL) || !*c->dir)
+        return false;
+
+    // Ströme („-“, Pipes, Geräte) lassen sich weder vorab hashen noch
+    // verknüpfen, und löschen darf man sie schon gar nicht
+    struct stat st;
+    if (!strcmp(input, "-") || !strcmp(output, "-") ||
+        (!lstat(output, &st) && !S_ISREG(st.st_mode)))
+        return false;
+
+    mkdir(c->dir, 0777);
+
+    int fd = open(input, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        return false;
+    }
+
+    char key[256];
+    int keylen = snprintf(key, sizeof(key), "%s%c%s%c%s", tool, 0, options, 0, CACHE_BUILD);
+    uint64_t hash = xxh64(key, (keylen < (int)sizeof(key)) ? keylen : (int)sizeof(key), 0);
+
+    if (st.st_size)
+    {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            close(fd);
+            return false;
+        }
+
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        hash = xxh64(map, st.st_size, hash);
+        munmap(map, st.st_size);
+    }
+    close(fd);
+
+    snprintf(c->entry, sizeof(c->entry), "%s/%016" PRIx64, c->dir, hash);
+    c->enabled = true;
+
+    // Nie in eine eventuell mit dem Cache verknüpfte alte Ausgabe schreiben
+    unlink(output);
+
+    int src = open(c->entry, O_RDONLY);
+    if (src >= 0)
+    {
+        bool ok = false;
+        int dst = open(output, O_WRONLY | O_CREAT | O_EXCL, 0666);
+        if (dst >= 0)
+        {
+            ok = !ioctl(dst, FICLONE, src);
+            close(dst);
+        }
+
+        if (!ok)
+        {
+            unlink(output);
+            ok = !link(c->entry, output);
+        }
+
+        if (!ok && ((dst = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0666)) >= 0))
+        {
+            ok = cache_copy(src, dst);
+            close(dst);
+        }
+
+        close(src);
+
+        if (ok)
+        {
+            cache_count(c, true);
+            return true;
+        }
+
+        unlink(output);
+    }
+
+    cache_count(c, false);
+    return false;
+}
+
+// Legt eine frisch erzeugte Ausgabe im Cache ab
+static inline void cache_store(struct npf_cache *c, const char *output)
+{
+    if (!c->enabled)
+        return;
+
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s/tmp.XXXXXX", c->dir);
+
+    int dst = mkstemp(tmp);
+    if (dst < 0)
+        return;
+
+    int src = open(output, O_RDONLY);
+    bool ok = (src >= 0) && cache_copy(src, dst);
+    if (src >= 0)
+        close(src);
+
+    ok = ok && !fchmod(dst, 0444);
+    close(dst);
+
+    // rename() ist atomar, parallel laufende Werkzeuge sehen also nie einen
+    // halb geschriebenen Eintrag
+    if (!ok || rename(tmp, c->entry))
+    {
+        unlink(tmp);
+        fprintf(stderr, "%s: Konnte nicht im Cache abgelegt werden.\n", output);
+    }
+}
+
+#endif
@@ -4,11 +4,19 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <termios.h>
 #include <unistd.h>
 #include <wchar.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <readline/readline.h>
 
+#include "blit.h"
+
 struct npf
 {
     char sig[3], version;
@@ -22,12 +30,236 @@ struct npf_char
     char rows[];
 } __attribute__((packed));
 
+// Ab Version 3 folgen jedem Zeichen hinter den Zeilen seine Metriken
+struct npf_metrics
+{
+    uint8_t advance;
+    uint8_t ink_x, ink_y, ink_w, ink_h;
+} __attribute__((packed));
+
 const char *cf = NULL;
 char fname[25] = { 0 };
 size_t chars, charsz;
 struct npf_char *char_array;
 unsigned width, height;
-bool font_valid = false;
+bool font_valid = false, has_metrics = false;
+uint32_t grid_next = 0;
+
+// Direkt bearbeitete (gemappte) Datei: char_array zeigt dann in die
+// Abbildung, Änderungen an bestehenden Zeichen landen sofort in der Datei.
+// Neue Zeichen kommen in das (ebenfalls sortierte) overlay, gelöschte werden
+// in removed markiert; beides wird erst beim Speichern eingearbeitet.
+struct npf *mapped = NULL;
+size_t mapped_size;
+dev_t mapped_dev;
+ino_t mapped_ino;
+struct npf_char *overlay = NULL;
+size_t overlay_chars = 0;
+uint8_t *removed = NULL;
+size_t removed_chars = 0;
+// Stellt sich eine gemappte Datei als unsortiert heraus, werden ihre
+// Zeichenindizes hier nach Code sortiert (sonst NULL)
+uint32_t *mapped_order = NULL;
+
+#define CHAR_IN(a, i) ((struct npf_char *)((uintptr_t)(a) + (i) * charsz))
+#define CHAR_AT(i) CHAR_IN(char_array, i)
+
+static int npf_char_comparison(const void *x, const void *y)
+{
+    uint32_t a = ((const struct npf_char *)x)->num, b = ((const struct npf_char *)y)->num;
+    return (a > b) - (a < b);
+}
+
+// char_array (und overlay) werden stets nach Unicodecode sortiert gehalten;
+// gibt den Index des ersten Zeichens mit einem Code >= unicode zurück.
+static size_t lower_bound_in(const struct npf_char *a, size_t n, uint32_t unicode)
+{
+    size_t lo = 0, hi = n;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (CHAR_IN(a, mid)->num < unicode)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static bool is_removed(size_t i)
+{
+    return (removed != NULL) && (removed[i / 8] & (1 << (i % 8)));
+}
+
+// Index in char_array des i-ten Zeichens in Unicodereihenfolge
+static size_t sorted_index(size_t i)
+{
+    return (mapped_order != NULL) ? mapped_order[i] : i;
+}
+
+static int mapped_order_comparison(const void *x, const void *y)
+{
+    uint32_t a = *(const uint32_t *)x, b = *(const uint32_t *)y;
+    if (CHAR_AT(a)->num != CHAR_AT(b)->num)
+        return (CHAR_AT(a)->num < CHAR_AT(b)->num) ? -1 : 1;
+    return (a > b) - (a < b);
+}
+
+// Legt für eine unsortierte gemappte Datei den Index an. Die Zeichen bleiben
+// an ihrem Platz in der Datei, Zeiger darauf also gültig.
+static void build_mapped_order(void)
+{
+    fprintf(stderr, "Datei ist nicht nach Code sortiert, es wird ein Index angelegt.\n");
+
+    mapped_order = malloc((chars ? chars : 1) * sizeof(*mapped_order));
+    for (size_t i = 0; i < chars; i++)
+        mapped_order[i] = i;
+    qsort(mapped_order, chars, sizeof(*mapped_order), mapped_order_comparison);
+}
+
+// Prüft die ganze gemappte Datei (nur für Befehle, die ohnehin alle Seiten
+// lesen)
+static void check_mapped_order(void)
+{
+    if ((mapped == NULL) || (mapped_order != NULL))
+        return;
+
+    for (size_t i = 1; i < chars; i++)
+    {
+        if (CHAR_AT(i - 1)->num >= CHAR_AT(i)->num)
+        {
+            build_mapped_order();
+            return;
+        }
+    }
+}
+
+// Wie lower_bound_in über die gemappte Datei. Beim Öffnen wird deren
+// Reihenfolge nicht geprüft (das würde jede Seite einlesen); stattdessen muss
+// jedes besuchte Zeichen zwischen den bisher besuchten liegen und kleiner als
+// sein Nachfolger sein (der meist auf derselben Seite liegt). Gibt false
+// zurück, wenn das nicht der Fall ist.
+static bool mapped_lower_bound(uint32_t unicode, size_t *pos)
+{
+    size_t lo = 0, hi = chars;
+    const struct npf_char *below = NULL, *above = NULL;
+
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        uint32_t num = CHAR_AT(mid)->num;
+
+        if (((below != NULL) && (num <= below->num)) || ((above != NULL) && (num >= above->num)))
+            return false;
+        if ((mid + 1 < chars) && (CHAR_AT(mid + 1)->num <= num))
+            return false;
+
+        if (num < unicode)
+        {
+            lo = mid + 1;
+            below = CHAR_AT(mid);
+        }
+        else
+        {
+            hi = mid;
+            above = CHAR_AT(mid);
+        }
+    }
+
+    *pos = lo;
+    return true;
+}
+
+static size_t live_chars(void)
+{
+    return chars - removed_chars + overlay_chars;
+}
+
+// Gibt das (nicht gelöschte) Zeichen mit dem kleinsten Code >= unicode
+// zurück, aus char_array oder overlay
+static struct npf_char *next_char(uint32_t unicode)
+{
+    if (!font_valid)
+        return NULL;
+
+    size_t i = 0;
+    if ((mapped != NULL) && (mapped_order == NULL) && !mapped_lower_bound(unicode, &i))
+        build_mapped_order();
+
+    if (mapped_order != NULL)
+    {
+        size_t lo = 0, hi = chars;
+        while (lo < hi)
+        {
+            size_t mid = lo + (hi - lo) / 2;
+            if (CHAR_AT(mapped_order[mid])->num < unicode)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        i = lo;
+    }
+    else if (mapped == NULL)
+        i = lower_bound_in(char_array, chars, unicode);
+
+    while ((i < chars) && is_removed(sorted_index(i)))
+        i++;
+
+    size_t j = lower_bound_in(overlay, overlay_chars, unicode);
+
+    struct npf_char *c = (i < chars) ? CHAR_AT(sorted_index(i)) : NULL;
+    if ((j < overlay_chars) && ((c == NULL) || (CHAR_IN(overlay, j)->num < c->num)))
+        c = CHAR_IN(overlay, j);
+    return c;
+}
+
+static struct npf_metrics *char_metrics(struct npf_char *c)
+{
+    return has_metrics ? (struct npf_metrics *)&c->rows[height] : NULL;
+}
+
+// Muss nach jeder Änderung an den Zeilen eines Zeichens aufgerufen werden
+static void update_ink(struct npf_char *c)
+{
+    struct npf_metrics *m = char_metrics(c);
+    if (m == NULL)
+        return;
+
+    uint8_t ink = 0;
+    int top = -1, bottom = -1;
+    for (unsigned y = 0; y < height; y++)
+    {
+        if (c->rows[y])
+        {
+            if (top < 0)
+                top = y;
+            bottom = y;
+            ink |= c->rows[y];
+        }
+    }
+
+    m->ink_x = m->ink_y = m->ink_w = m->ink_h = 0;
+    if (ink)
+    {
+        m->ink_x = __builtin_ctz(ink);
+        m->ink_w = 32 - __builtin_clz(ink) - m->ink_x;
+        m->ink_y = top;
+        m->ink_h = bottom + 1 - top;
+    }
+}
+
+static void write_out(const char *buf, size_t len)
+{
+    fflush(stdout);
+    while (len)
+    {
+        ssize_t ret = write(STDOUT_FILENO, buf, len);
+        if (ret <= 0)
+            return;
+        buf += ret;
+        len -= ret;
+    }
+}
 
 static bool load_font(const char *name)
 {
@@ -57,7 +289,7 @@ static bool load_font(const char *name)
         return false;
     }
 
-    if (npf->version != '2')
+    if ((npf->version != '2') && (npf->version != '3'))
     {
         fprintf(stderr, "Nicht unterstützte Version.\n");
         return false;
@@ -70,7 +302,8 @@ static bool load_font(const char *name)
         return false;
     }
 
-    charsz = npf->height + sizeof(uint32_t);
+    has_metrics = npf->version >= '3';
+    charsz = npf->height + sizeof(uint32_t) + (has_metrics ? sizeof(struct npf_metrics) : 0);
 
     if ((filesz - sizeof(struct npf)) % charsz)
     {
@@ -82,93 +315,1317 @@ static bool load_font(const char *name)
     char_array = malloc(chars * charsz);
     memcpy(char_array, npf + 1, chars * charsz);
 
-    width = npf->width;
-    height = npf->height;
+    for (size_t i = 1; i < chars; i++)
+    {
+        if (CHAR_AT(i - 1)->num > CHAR_AT(i)->num)
+        {
+            qsort(char_array, chars, charsz, npf_char_comparison);
+            break;
+        }
+    }
+
+    grid_next = 0;
+
+    width = npf->width;
+    height = npf->height;
+
+    strncpy(fname, npf->name, 24);
+
+    free(npf);
+
+    printf("%u×%u-Schriftart „%s“ geladen.\n", width, height, fname);
+
+    return true;
+}
+
+// Öffnet eine (nach Unicodecode sortierte) Datei zur direkten Bearbeitung.
+// Es werden nur die Seiten eingelesen, die tatsächlich angefasst werden.
+static bool map_font(const char *name)
+{
+    int fd = open(name, O_RDWR);
+    if (fd < 0)
+    {
+        perror("Konnte Datei nicht öffnen");
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        perror("Konnte Datei nicht öffnen");
+        close(fd);
+        return false;
+    }
+
+    if ((size_t)st.st_size < sizeof(struct npf))
+    {
+        fprintf(stderr, "Datei ist zu klein.\n");
+        close(fd);
+        return false;
+    }
+
+    struct npf *npf = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (npf == MAP_FAILED)
+    {
+        perror("Konnte Datei nicht mappen");
+        return false;
+    }
+
+    madvise(npf, st.st_size, MADV_RANDOM);
+
+    if (strncmp(npf->sig, "NPF", 3))
+    {
+        fprintf(stderr, "Keine NPF-Datei.\n");
+        munmap(npf, st.st_size);
+        return false;
+    }
+
+    if ((npf->version != '2') && (npf->version != '3'))
+    {
+        fprintf(stderr, "Nicht unterstützte Version.\n");
+        munmap(npf, st.st_size);
+        return false;
+    }
+
+    if (npf->width > 8)
+    {
+        fprintf(stderr, "Schriftarten, die breiter als acht Pixel sind, werden nicht unterstützt.\n");
+        munmap(npf, st.st_size);
+        return false;
+    }
+
+    has_metrics = npf->version >= '3';
+    charsz = npf->height + sizeof(uint32_t) + (has_metrics ? sizeof(struct npf_metrics) : 0);
+
+    if ((st.st_size - sizeof(struct npf)) % charsz)
+    {
+        fprintf(stderr, "Ungültige Dateigröße (kein Vielfaches der Zeichengröße).\n");
+        munmap(npf, st.st_size);
+        return false;
+    }
+
+    mapped = npf;
+    mapped_size = st.st_size;
+    mapped_dev = st.st_dev;
+    mapped_ino = st.st_ino;
+
+    chars = (st.st_size - sizeof(struct npf)) / charsz;
+    char_array = (struct npf_char *)(npf + 1);
+
+    grid_next = 0;
+
+    width = npf->width;
+    height = npf->height;
+
+    strncpy(fname, npf->name, 24);
+
+    printf("%u×%u-Schriftart „%s“ zur direkten Bearbeitung geöffnet.\n", width, height, fname);
+
+    return true;
+}
+
+// Ähnlichkeitssuche: Jedes Zeichen wird als Bitfolge seiner Zeilen in
+// 64-Bit-Wörter gepackt, der Abstand zweier Zeichen ist die Zahl
+// unterschiedlicher Pixel (Hamming-Abstand, per popcount). Damit nicht jede
+// Anfrage alle Zeichen vergleichen muss, wird die Bitfolge in Stücke zu
+// 16 Bit geteilt, und für jedes Stück gibt es eine Tabelle aller Zeichen
+// nach dessen Wert (Multi-Index-Hashing). Die Stücke bestehen nicht aus
+// benachbarten Zeilen, sondern aus über das ganze Zeichen verstreuten Pixeln,
+// denn die oberen und unteren Zeilen sind meist bei fast allen Zeichen leer
+// und würden alle in dasselbe Fach legen. Unterscheiden sich zwei Zeichen
+// in höchstens m * (s + 1) - 1 Bits, stimmt mindestens eines ihrer m Stücke
+// bis auf s Bits überein; gesucht wird also mit wachsendem s nur in den
+// Fächern, die so nahe am Stück der Anfrage liegen.
+//
+// Der Index wird bei der ersten Anfrage aufgebaut und bei jeder Änderung an
+// der Schriftart verworfen.
+#define SIMILAR_CHUNK_BITS 16
+#define SIMILAR_BUCKETS (1 << SIMILAR_CHUNK_BITS)
+
+struct similar_index
+{
+    bool valid;
+    size_t glyphs, words, chunks;
+    uint32_t *nums;    // Codes, aufsteigend
+    uint64_t *codes;   // glyphs * words
+    uint16_t *keys;    // glyphs * chunks Werte der Stücke
+    uint32_t *start;   // Je Stück SIMILAR_BUCKETS + 1 Anfänge in ids
+    uint32_t *ids;     // Je Stück alle Zeichen, nach dem Wert des Stücks sortiert
+    uint32_t *seen, seen_gen;
+};
+
+struct similar_index similar;
+
+static void similar_invalidate(void)
+{
+    similar.valid = false;
+}
+
+static unsigned gcd(unsigned a, unsigned b)
+{
+    while (b)
+    {
+        unsigned t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static unsigned similar_chunk_bits(size_t j)
+{
+    return (j + 1 < similar.chunks) ? SIMILAR_CHUNK_BITS : height * 8 - j * SIMILAR_CHUNK_BITS;
+}
+
+static unsigned hamming(const uint64_t *a, const uint64_t *b, size_t words)
+{
+    unsigned d = 0;
+    for (size_t i = 0; i < words; i++)
+        d += __builtin_popcountll(a[i] ^ b[i]);
+    return d;
+}
+
+static void similar_build(void)
+{
+    free(similar.nums);
+    free(similar.codes);
+    free(similar.keys);
+    free(similar.start);
+    free(similar.ids);
+    free(similar.seen);
+
+    size_t n = live_chars();
+    size_t words = (height * 8 + 63) / 64;
+    size_t chunks = (height * 8 + SIMILAR_CHUNK_BITS - 1) / SIMILAR_CHUNK_BITS;
+
+    similar.glyphs = n;
+    similar.words = words;
+    similar.chunks = chunks;
+    similar.nums = malloc(n * sizeof(uint32_t));
+    similar.codes = calloc(n * words, sizeof(uint64_t));
+    similar.keys = calloc(n * chunks, sizeof(uint16_t));
+    similar.start = calloc(chunks * (SIMILAR_BUCKETS + 1), sizeof(uint32_t));
+    similar.ids = malloc(chunks * n * sizeof(uint32_t));
+    similar.seen = calloc(n, sizeof(uint32_t));
+    similar.seen_gen = 0;
+
+    size_t i = 0;
+    for (struct npf_char *c = next_char(0); c != NULL; c = next_char(c->num + 1))
+    {
+        similar.nums[i] = c->num;
+        memcpy(&similar.codes[i * words], c->rows, height);
+        i++;
+        if (c->num == UINT32_MAX)
+            break;
+    }
+
+    // Bit b eines Stücks ist Pixel (i * step) % bits mit i = j * 16 + b; da
+    // step teilerfremd zu bits ist, kommt jedes Pixel genau einmal vor
+    unsigned bits = height * 8, step = (bits * 37 / 128) | 1;
+    while (gcd(step, bits) != 1)
+        step += 2;
+
+    for (size_t k = 0; k < n; k++)
+    {
+        const uint64_t *code = &similar.codes[k * words];
+        for (unsigned i = 0; i < bits; i++)
+        {
+            unsigned p = (unsigned)((uint64_t)i * step % bits);
+            similar.keys[k * chunks + i / SIMILAR_CHUNK_BITS] |= ((code[p / 64] >> (p % 64)) & 1) << (i % SIMILAR_CHUNK_BITS);
+        }
+    }
+
+    // Fächer per Zählen sortieren
+    for (size_t j = 0; j < chunks; j++)
+    {
+        uint32_t *start = &similar.start[j * (SIMILAR_BUCKETS + 1)];
+        uint32_t *ids = &similar.ids[j * n];
+
+        for (size_t k = 0; k < n; k++)
+            start[similar.keys[k * chunks + j] + 1]++;
+        for (size_t b = 0; b < SIMILAR_BUCKETS; b++)
+            start[b + 1] += start[b];
+
+        uint32_t *pos = malloc(SIMILAR_BUCKETS * sizeof(uint32_t));
+        memcpy(pos, start, SIMILAR_BUCKETS * sizeof(uint32_t));
+        for (size_t k = 0; k < n; k++)
+            ids[pos[similar.keys[k * chunks + j]]++] = k;
+        free(pos);
+    }
+
+    similar.valid = true;
+}
+
+struct similar_match
+{
+    unsigned dist;
+    uint32_t id;
+};
+
+// Fügt id in die nach Abstand sortierte Liste der k besten ein
+static void similar_insert(struct similar_match *best, size_t *found, size_t k, unsigned dist, uint32_t id)
+{
+    if ((*found == k) && (dist >= best[k - 1].dist))
+        return;
+
+    size_t i = (*found < k) ? (*found)++ : k - 1;
+    while ((i > 0) && (best[i - 1].dist > dist))
+    {
+        best[i] = best[i - 1];
+        i--;
+    }
+    best[i] = (struct similar_match){ .dist = dist, .id = id };
+}
+
+static void find_similar(uint32_t unicode, size_t k)
+{
+    if (!similar.valid)
+        similar_build();
+
+    size_t lo = 0, hi = similar.glyphs;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (similar.nums[mid] < unicode)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if ((lo >= similar.glyphs) || (similar.nums[lo] != unicode))
+    {
+        fprintf(stderr, "Zeichen nicht gefunden.\n");
+        return;
+    }
+
+    if (k > similar.glyphs - 1)
+        k = similar.glyphs - 1;
+    if (!k)
+    {
+        printf("Keine anderen Zeichen vorhanden.\n");
+        return;
+    }
+
+    uint32_t self = lo;
+    const uint64_t *query = &similar.codes[self * similar.words];
+    size_t n = similar.glyphs, m = similar.chunks, found = 0, checked = 0;
+    struct similar_match *best = malloc(k * sizeof(*best));
+
+    if (!++similar.seen_gen)
+    {
+        memset(similar.seen, 0, n * sizeof(uint32_t));
+        similar.seen_gen = 1;
+    }
+    similar.seen[self] = similar.seen_gen;
+
+    for (unsigned s = 0; s <= SIMILAR_CHUNK_BITS; s++)
+    {
+        for (size_t j = 0; j < m; j++)
+        {
+            // Das letzte Stück ist eventuell kürzer
+            unsigned bits = similar_chunk_bits(j);
+            if (s > bits)
+                continue;
+
+            const uint32_t *start = &similar.start[j * (SIMILAR_BUCKETS + 1)];
+            const uint32_t *ids = &similar.ids[j * n];
+            unsigned q = similar.keys[self * m + j];
+
+            // Alle Masken mit genau s gesetzten Bits (Gosper)
+            for (unsigned mask = (1u << s) - 1; mask < (1u << bits);)
+            {
+                unsigned key = q ^ mask;
+                for (uint32_t b = start[key]; b < start[key + 1]; b++)
+                {
+                    uint32_t id = ids[b];
+                    if (similar.seen[id] == similar.seen_gen)
+                        continue;
+                    similar.seen[id] = similar.seen_gen;
+
+                    checked++;
+                    similar_insert(best, &found, k, hamming(query, &similar.codes[id * similar.words], similar.words), id);
+                }
+
+                if (!mask)
+                    break;
+                unsigned low = mask & -mask, r = mask + low;
+                mask = (((r ^ mask) >> 2) / low) | r;
+            }
+        }
+
+        // Alles, was noch nicht gefunden wurde, weicht in jedem Stück um
+        // mehr als s Bits ab
+        if ((found == k) && (best[k - 1].dist < m * (s + 1)))
+            break;
+    }
+
+    for (size_t i = 0; i < found; i++)
+    {
+        uint32_t num = similar.nums[best[i].id];
+
+        // Nicht jeder Code lässt sich ausgeben (z. B. Surrogate)
+        char chr[MB_LEN_MAX + 1];
+        if (snprintf(chr, sizeof(chr), "%lc", (wint_t)num) < 0)
+            strcpy(chr, "?");
+
+        printf("%s (U+0x%04X): %u Pixel Unterschied\n", chr, (unsigned)num, best[i].dist);
+    }
+    printf("(%zu von %zu Zeichen verglichen)\n", checked, n - 1);
+
+    free(best);
+}
+
+// Historie für undo/redo: Einträge liegen hintereinander in einem Ringpuffer
+// fester Größe; ist er voll, fallen die ältesten Befehle heraus. Positionen
+// sind fortlaufend und werden erst beim Zugriff auf den Puffer umgebrochen.
+//
+// Jeder Eintrag besteht aus struct undo_entry, den Nutzdaten und seiner
+// Gesamtlänge (damit man auch rückwärts laufen kann). Geänderte Zeichen
+// werden als (Offset, XOR-Byte)-Paare über Zeilen und Metriken abgelegt, die
+// für undo und redo gleichermaßen angewandt werden; hinzugefügte und
+// gelöschte Zeichen mit ihrem ganzen Inhalt. Alle Einträge eines Befehls
+// bilden eine Gruppe.
+#define UNDO_ARENA_SIZE (1 << 20)
+
+enum undo_kind
+{
+    UNDO_ROWS,
+    UNDO_ADD,
+    UNDO_REMOVE,
+    UNDO_NAME
+};
+
+#define UNDO_CONT 1 // Gehört zur selben Gruppe wie der vorige Eintrag
+
+struct undo_entry
+{
+    uint32_t num;
+    uint8_t kind, flags;
+    uint16_t rsvd;
+    uint32_t len;
+} __attribute__((packed));
+
+struct undo_diff
+{
+    uint16_t offset;
+    uint8_t xor;
+} __attribute__((packed));
+
+uint8_t undo_arena[UNDO_ARENA_SIZE];
+uint64_t undo_head = 0, undo_pos = 0, undo_tail = 0, undo_group = 0;
+bool undo_new_group = true, undo_dropped = false;
+
+static void ring_write(uint64_t pos, const void *src, size_t len)
+{
+    size_t off = pos % UNDO_ARENA_SIZE, first = (len < UNDO_ARENA_SIZE - off) ? len : UNDO_ARENA_SIZE - off;
+    memcpy(&undo_arena[off], src, first);
+    memcpy(undo_arena, (const uint8_t *)src + first, len - first);
+}
+
+static void ring_read(uint64_t pos, void *dst, size_t len)
+{
+    size_t off = pos % UNDO_ARENA_SIZE, first = (len < UNDO_ARENA_SIZE - off) ? len : UNDO_ARENA_SIZE - off;
+    memcpy(dst, &undo_arena[off], first);
+    memcpy((uint8_t *)dst + first, undo_arena, len - first);
+}
+
+static void undo_clear(void)
+{
+    similar_invalidate();
+
+    undo_head = undo_pos = undo_tail = undo_group = 0;
+    undo_new_group = true;
+    undo_dropped = false;
+}
+
+// Gibt die Zeichen frei, behält aber die Historie (für das erneute Mappen
+// nach dem Speichern)
+static void unload_font(void)
+{
+    if (!font_valid)
+        return;
+
+    if (mapped != NULL)
+        munmap(mapped, mapped_size);
+    else
+        free(char_array);
+
+    free(overlay);
+    free(removed);
+    free(mapped_order);
+
+    mapped = NULL;
+    char_array = NULL;
+    overlay = NULL;
+    removed = NULL;
+    mapped_order = NULL;
+    chars = overlay_chars = removed_chars = 0;
+    font_valid = false;
+}
+
+static void close_font(void)
+{
+    unload_font();
+    undo_clear();
+}
+
+static void save_font(const char *fpname)
+{
+    FILE *fp = fopen(fpname, "wb");
+    if (fp == NULL)
+    {
+        perror("Konnte die Datei nicht erstellen");
+        return;
+    }
+
+    struct npf npf = {
+        .sig = "NPF",
+        .version = has_metrics ? '3' : '2',
+        .width = width,
+        .height = height
+    };
+    memcpy(npf.name, fname, 24);
+
+    fwrite(&npf, 1, sizeof(npf), fp);
+
+    if ((overlay_chars == 0) && (removed_chars == 0) && (mapped_order == NULL))
+        fwrite(char_array, chars, charsz, fp);
+    else
+    {
+        for (struct npf_char *c = next_char(0); c != NULL; c = next_char(c->num + 1))
+        {
+            fwrite(c, 1, charsz, fp);
+            if (c->num == UINT32_MAX)
+                break;
+        }
+    }
+
+    fclose(fp);
+}
+
+// Speichert eine direkt bearbeitete Schriftart. Ohne hinzugefügte oder
+// gelöschte Zeichen genügt es, die geänderten Seiten zurückzuschreiben;
+// sonst wird die Datei neu geschrieben und wieder gemappt.
+static void save_mapped_font(const char *fpname)
+{
+    struct stat st;
+    if (stat(fpname, &st) || (st.st_dev != mapped_dev) || (st.st_ino != mapped_ino))
+    {
+        save_font(fpname);
+        return;
+    }
+
+    if ((overlay_chars == 0) && (removed_chars == 0))
+    {
+        if (msync(mapped, mapped_size, MS_SYNC))
+            perror("Konnte die Datei nicht schreiben");
+        return;
+    }
+
+    size_t len = strlen(fpname);
+    char tmpname[len + 5];
+    memcpy(tmpname, fpname, len);
+    memcpy(tmpname + len, ".neu", 5);
+
+    save_font(tmpname);
+
+    if (rename(tmpname, fpname))
+    {
+        perror("Konnte die Datei nicht ersetzen");
+        return;
+    }
+
+    // Die Historie bezieht sich auf Codes, nicht auf Positionen in der
+    // Datei, und bleibt daher gültig
+    uint32_t gn = grid_next;
+    unload_font();
+    if ((font_valid = map_font(fpname)))
+        grid_next = gn;
+}
+
+static struct npf_char *get_char(uint32_t unicode)
+{
+    struct npf_char *c = next_char(unicode);
+    return ((c != NULL) && (c->num == unicode)) ? c : NULL;
+}
+
+// Fügt ein Zeichen mit dem angegebenen Inhalt (Zeilen und Metriken) ein,
+// ohne Prüfung und ohne Eintrag in die Historie
+static struct npf_char *insert_char(uint32_t unicode, const void *data)
+{
+    // Eine gemappte Datei wird nicht vergrößert, neue Zeichen kommen ins overlay
+    struct npf_char **array = (mapped != NULL) ? &overlay : &char_array;
+    size_t *count = (mapped != NULL) ? &overlay_chars : &chars;
+
+    size_t i = lower_bound_in(*array, *count, unicode);
+
+    *array = realloc(*array, ++*count * charsz);
+    memmove(CHAR_IN(*array, i + 1), CHAR_IN(*array, i), (*count - 1 - i) * charsz);
+
+    struct npf_char *c = CHAR_IN(*array, i);
+    c->num = unicode;
+    memcpy(c->rows, data, charsz - sizeof(uint32_t));
+
+    return c;
+}
+
+static void delete_char(struct npf_char *c)
+{
+    if ((overlay_chars > 0) && (c >= overlay) && (c < CHAR_IN(overlay, overlay_chars)))
+        memmove(c, (const void *)((uintptr_t)c + charsz), (--overlay_chars * charsz) - ((uintptr_t)c - (uintptr_t)overlay));
+    else if (mapped != NULL)
+    {
+        size_t i = ((uintptr_t)c - (uintptr_t)char_array) / charsz;
+        if (removed == NULL)
+            removed = calloc((chars + 7) / 8, 1);
+        removed[i / 8] |= 1 << (i % 8);
+        removed_chars++;
+    }
+    else
+        memmove(c, (const void *)((uintptr_t)c + charsz), (--chars * charsz) - ((uintptr_t)c - (uintptr_t)char_array));
+}
+
+// Jede Änderung an der Schriftart wird hier festgehalten
+static void undo_record(uint32_t num, enum undo_kind kind, const void *data, size_t len)
+{
+    similar_invalidate();
+
+    if (undo_new_group)
+    {
+        undo_group = undo_pos;
+        undo_dropped = false;
+    }
+    else if (undo_dropped)
+        return;
+
+    // Was rückgängig gemacht wurde, kann danach nicht wiederhergestellt werden
+    undo_tail = undo_pos;
+
+    struct undo_entry e = {
+        .num = num,
+        .kind = kind,
+        .flags = undo_new_group ? 0 : UNDO_CONT,
+        .len = len
+    };
+    uint32_t total = sizeof(e) + len + sizeof(total);
+
+    undo_new_group = false;
+
+    while (undo_tail - undo_head + total > UNDO_ARENA_SIZE)
+    {
+        if (undo_head >= undo_group)
+        {
+            // Der Befehl passt nicht einmal allein in den Puffer
+            fprintf(stderr, "Änderung ist zu groß, sie kann nicht rückgängig gemacht werden.\n");
+            undo_head = undo_pos = undo_tail = undo_group;
+            undo_dropped = true;
+            return;
+        }
+
+        // Ältesten Befehl vollständig verwerfen
+        struct undo_entry old;
+        do
+        {
+            ring_read(undo_head, &old, sizeof(old));
+            undo_head += sizeof(old) + old.len + sizeof(uint32_t);
+            if (undo_head < undo_tail)
+                ring_read(undo_head, &old, sizeof(old));
+        }
+        while ((undo_head < undo_group) && (old.flags & UNDO_CONT));
+    }
+
+    ring_write(undo_tail, &e, sizeof(e));
+    ring_write(undo_tail + sizeof(e), data, len);
+    ring_write(undo_tail + sizeof(e) + len, &total, sizeof(total));
+    undo_pos = undo_tail += total;
+}
+
+// Vergleicht ein Zeichen mit seinem Inhalt vor einer Änderung und legt die
+// geänderten Bytes ab
+static void undo_record_rows(const struct npf_char *c, const char *before)
+{
+    size_t len = charsz - sizeof(uint32_t), n = 0;
+    struct undo_diff diff[len];
+
+    for (size_t i = 0; i < len; i++)
+        if (before[i] != c->rows[i])
+            diff[n++] = (struct undo_diff){ .offset = i, .xor = before[i] ^ c->rows[i] };
+
+    if (n)
+        undo_record(c->num, UNDO_ROWS, diff, n * sizeof(*diff));
+}
+
+static void undo_apply(uint64_t pos, bool redo)
+{
+    similar_invalidate();
+
+    struct undo_entry e;
+    ring_read(pos, &e, sizeof(e));
+
+    uint8_t *data = malloc(e.len ? e.len : 1);
+    ring_read(pos + sizeof(e), data, e.len);
+
+    struct npf_char *c = get_char(e.num);
+
+    switch (e.kind)
+    {
+        case UNDO_ROWS:
+            for (size_t i = 0; (c != NULL) && (i < e.len / sizeof(struct undo_diff)); i++)
+            {
+                struct undo_diff d;
+                memcpy(&d, &data[i * sizeof(d)], sizeof(d));
+                c->rows[d.offset] ^= d.xor;
+            }
+            break;
+
+        case UNDO_ADD:
+        case UNDO_REMOVE:
+            if ((e.kind == UNDO_ADD) == redo)
+            {
+                if (c == NULL)
+                    insert_char(e.num, data);
+            }
+            else if (c != NULL)
+                delete_char(c);
+            break;
+
+        case UNDO_NAME:
+            for (size_t i = 0; i < 24; i++)
+                fname[i] ^= data[i];
+            if (mapped != NULL)
+                memcpy(mapped->name, fname, 24);
+            break;
+    }
+
+    free(data);
+}
+
+static void undo(void)
+{
+    if (undo_pos == undo_head)
+    {
+        fprintf(stderr, "Nichts rückgängig zu machen.\n");
+        return;
+    }
+
+    // Die Einträge einer Gruppe rückwärts anwenden, bis zu ihrem ersten
+    struct undo_entry e;
+    do
+    {
+        uint32_t total;
+        ring_read(undo_pos - sizeof(total), &total, sizeof(total));
+        undo_pos -= total;
+
+        ring_read(undo_pos, &e, sizeof(e));
+        undo_apply(undo_pos, false);
+    }
+    while ((e.flags & UNDO_CONT) && (undo_pos > undo_head));
+}
+
+static void redo(void)
+{
+    if (undo_pos == undo_tail)
+    {
+        fprintf(stderr, "Nichts wiederherzustellen.\n");
+        return;
+    }
+
+    struct undo_entry e;
+    do
+    {
+        ring_read(undo_pos, &e, sizeof(e));
+        undo_apply(undo_pos, true);
+        undo_pos += sizeof(e) + e.len + sizeof(uint32_t);
+
+        if (undo_pos < undo_tail)
+            ring_read(undo_pos, &e, sizeof(e));
+    }
+    while ((undo_pos < undo_tail) && (e.flags & UNDO_CONT));
+}
+
+static void add_char(uint32_t unicode, uint32_t uni_src)
+{
+    if (!font_valid)
+    {
+        fprintf(stderr, "Keine Schriftart aktiv.\n");
+        return;
+    }
+
+    if (get_char(unicode) != NULL)
+    {
+        fprintf(stderr, "Zeichen existiert bereits.\n");
+        return;
+    }
+
+    struct npf_char *src = NULL;
+    if (uni_src)
+    {
+        src = get_char(uni_src);
+        if (src == NULL)
+        {
+            fprintf(stderr, "Quellzeichen nicht gefunden.\n");
+            return;
+        }
+    }
+
+    // Nach dem realloc() ist src eventuell ungültig, also vorher kopieren
+    char data[charsz - sizeof(uint32_t)];
+    if (src != NULL)
+        memcpy(data, src->rows, sizeof(data));
+    else
+    {
+        memset(data, 0, sizeof(data));
+        if (has_metrics)
+            ((struct npf_metrics *)&data[height])->advance = width;
+    }
+
+    insert_char(unicode, data);
+    undo_record(unicode, UNDO_ADD, data, sizeof(data));
+
+    printf("Zeichen %lc (U+0x%04X) hinzugefügt.\n", (wint_t)unicode, (unsigned)unicode);
+}
+
+static void remove_char(uint32_t unicode)
+{
+    if (!font_valid)
+    {
+        fprintf(stderr, "Keine Schriftart aktiv.\n");
+        return;
+    }
+
+    struct npf_char *c;
+    if ((c = get_char(unicode)) == NULL)
+    {
+        fprintf(stderr, "Zeichen nicht gefunden.\n");
+        return;
+    }
+
+    undo_record(unicode, UNDO_REMOVE, c->rows, charsz - sizeof(uint32_t));
+    delete_char(c);
+
+    printf("Zeichen %lc (U+0x%04X) entfernt.\n", (wint_t)unicode, (unsigned)unicode);
+}
+
+static void show_char(uint32_t unicode)
+{
+    struct npf_char *c = get_char(unicode);
+    if (c == NULL)
+    {
+        fprintf(stderr, "Zeichen nicht gefunden.\n");
+        return;
+    }
+
+    uint8_t pixels[height * width];
+    struct blit blitter = blit_select(width, height, 1);
+    blit(&blitter, pixels, width, (const uint8_t *)c->rows, 1, 0);
+
+    // „█“ ist in UTF-8 drei Bytes lang, „·“ zwei
+    char buf[height * (width * 3 + 1)], *p = buf;
+    for (unsigned y = 0; y < height; y++)
+    {
+        for (unsigned x = 0; x < width; x++)
+        {
+            if (pixels[y * width + x])
+            {
+                memcpy(p, "█", 3);
+                p += 3;
+            }
+            else
+            {
+                memcpy(p, "·", 2);
+                p += 2;
+            }
+        }
+        *(p++) = '\n';
+    }
+
+    write_out(buf, p - buf);
+
+    const struct npf_metrics *m = char_metrics(c);
+    if (m != NULL)
+        printf("Vorschub %u, Tinte %u×%u bei (%u, %u)\n", m->advance, m->ink_w, m->ink_h, m->ink_x, m->ink_y);
+}
+
+static void list_chars(void)
+{
+    // „X (U+0x10FFFF)\n“ mit bis zu vier Bytes für das UTF-8-Zeichen
+    char *buf = malloc(live_chars() * 24 + 1), *p = buf;
+
+    for (struct npf_char *c = next_char(0); c != NULL; c = next_char(c->num + 1))
+    {
+        int len = sprintf(p, "%lc (U+0x%04X)\n", (wint_t)c->num, (unsigned)c->num);
+        if (len > 0)
+            p += len;
+        if (c->num == UINT32_MAX)
+            break;
+    }
+
+    write_out(buf, p - buf);
+    free(buf);
+}
+
+// Zeigt eine Bildschirmseite voller Zeichen ab dem Code grid_next an. Je 2×4
+// Pixel werden in einem Braillezeichen (U+2800 bis U+28FF) dargestellt.
+static void show_grid(void)
+{
+    if (!font_valid || !live_chars())
+    {
+        fprintf(stderr, "Keine Zeichen vorhanden.\n");
+        return;
+    }
+
+    static const uint8_t dots[4][4] = {
+        { 0x00, 0x01, 0x08, 0x09 },
+        { 0x00, 0x02, 0x10, 0x12 },
+        { 0x00, 0x04, 0x20, 0x24 },
+        { 0x00, 0x40, 0x80, 0xC0 }
+    };
+
+    struct winsize ws;
+    unsigned term_w = 80, term_h = 24;
+    if (!ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) && ws.ws_col && ws.ws_row)
+    {
+        term_w = ws.ws_col;
+        term_h = ws.ws_row;
+    }
+
+    unsigned cell_w = (width + 1) / 2, cell_h = (height + 3) / 4;
+    unsigned col_w = (cell_w > 6) ? cell_w : 6;
+    unsigned cols = term_w / (col_w + 1), lines = (term_h > 2) ? (term_h - 2) / (cell_h + 1) : 1;
+    if (!cols)
+        cols = 1;
+    if (!lines)
+        lines = 1;
+
+    struct npf_char *next = next_char(grid_next);
+    if (next == NULL)
+        next = next_char(0);
+
+    // Drei Bytes je Braillezeichen
+    char *buf = malloc(lines * (cell_h + 1) * (cols * (col_w * 3 + 1) + 1) + 1), *p = buf;
+    const struct npf_char *row[cols];
+
+    for (unsigned l = 0; (l < lines) && (next != NULL); l++)
+    {
+        size_t n = 0;
+        while ((n < cols) && (next != NULL))
+        {
+            row[n++] = next;
+            next = (next->num < UINT32_MAX) ? next_char(next->num + 1) : NULL;
+        }
+
+        for (unsigned cy = 0; cy < cell_h; cy++)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                const struct npf_char *c = row[i];
+                for (unsigned cx = 0; cx < cell_w; cx++)
+                {
+                    unsigned d = 0;
+                    for (unsigned r = 0; (r < 4) && (cy * 4 + r < height); r++)
+                        d |= dots[r][((uint8_t)c->rows[cy * 4 + r] >> (cx * 2)) & 3];
+
+                    unsigned cp = 0x2800 + d;
+                    *(p++) = 0xE0 | (cp >> 12);
+                    *(p++) = 0x80 | ((cp >> 6) & 0x3F);
+                    *(p++) = 0x80 | (cp & 0x3F);
+                }
+                for (unsigned cx = cell_w; cx < col_w + 1; cx++)
+                    *(p++) = ' ';
+            }
+            *(p++) = '\n';
+        }
+
+        for (size_t i = 0; i < n; i++)
+            p += sprintf(p, "%-*X ", col_w, (unsigned)row[i]->num);
+        *(p++) = '\n';
+    }
+
+    grid_next = (next != NULL) ? next->num : 0;
+
+    write_out(buf, p - buf);
+    free(buf);
+}
+
+static void edit_char(uint32_t unicode)
+{
+    struct npf_char *c = get_char(unicode);
+    if (c == NULL)
+    {
+        fprintf(stderr, "Zeichen nicht gefunden.\n");
+        return;
+    }
+
+    show_char(unicode);
+
+    printf("Gib neues Zeichen mit Raute (#) und Leerzeichen ( ) ein:\n");
+    printf("(x, um das letzte Zeichen zu löschen; l, um zur letzten Zeile zurückzugehen; n, um die Zeile nicht zu verändern)\n");
+
+    char tbuf[height];
+    memcpy(tbuf, c->rows, height);
+
+    struct termios old_tio, new_tio;
+    tcgetattr(0, &old_tio);
+    new_tio = old_tio;
+    new_tio.c_lflag &= ~ICANON;
+    tcsetattr(0, TCSANOW, &new_tio);
+
+    for (unsigned y = 0; y < height; y++)
+    {
+        printf("[%02i] ", y);
+        for (unsigned x = 0; x < width; x++)
+        {
+            recol:
+
+            switch (getchar())
+            {
+                case '#':
+                    tbuf[y] |= 1 << x;
+                    break;
+                case ' ':
+                    tbuf[y] &= ~(1 << x);
+                    break;
+                case 'x':
+                    if (!x)
+                        printf("\b \b");
+                    else
+                    {
+                        x--;
+                        printf("\b\b  \b\b");
+                    }
+                    goto recol;
+                case 'l':
+                    if (y)
+                        printf("\r[%02i] ", --y);
+                    x = 0;
+                    goto recol;
+                case 'n':
+                    putchar('\b');
+                    for (; x < width; x++)
+                        putchar((tbuf[y] & (1 << x)) ? '#' : ' ');
+                    break;
+                default:
+                    fprintf(stderr, "Ungültige Eingabe. Abbruch.\n");
+                    return;
+            }
+        }
+
+        putchar('\n');
+    }
+
+    tcsetattr(0, TCSANOW, &old_tio);
+
+    char before[charsz - sizeof(uint32_t)];
+    memcpy(before, c->rows, sizeof(before));
+
+    memcpy(c->rows, tbuf, height);
+    update_ink(c);
+    undo_record_rows(c, before);
+}
+
+static void move_char(uint32_t unicode, int y)
+{
+    struct npf_char *c = get_char(unicode);
+    if (c == NULL)
+    {
+        fprintf(stderr, "Zeichen nicht gefunden.\n");
+        return;
+    }
+
+    char before[charsz - sizeof(uint32_t)];
+    memcpy(before, c->rows, sizeof(before));
+
+    if (y > 0)
+    {
+        memmove(&c->rows[y], c->rows, height - y);
+        memset(c->rows, 0, y);
+    }
+    else
+    {
+        memmove(c->rows, &c->rows[-y], height + y);
+        memset(&c->rows[height + y], 0, -y);
+    }
+
+    update_ink(c);
+    undo_record_rows(c, before);
+}
+
+static void set_advance(uint32_t unicode, unsigned long advance)
+{
+    if (!has_metrics)
+    {
+        fprintf(stderr, "Die Schriftart hat keine Metriken (Version 2).\n");
+        return;
+    }
+
+    struct npf_char *c = get_char(unicode);
+    if (c == NULL)
+    {
+        fprintf(stderr, "Zeichen nicht gefunden.\n");
+        return;
+    }
+
+    if (advance > UINT8_MAX)
+    {
+        fprintf(stderr, "Ungültiger Vorschub.\n");
+        return;
+    }
+
+    char before[charsz - sizeof(uint32_t)];
+    memcpy(before, c->rows, sizeof(before));
+
+    char_metrics(c)->advance = advance;
+    undo_record_rows(c, before);
+}
+
+// Zu importierende Zeichen: je Datensatz Code, ein Byte je Zeile der
+// Quellschriftart (die wie die bearbeitete höchstens acht Pixel breit ist)
+// und der Vorschub
+struct import
+{
+    uint8_t *data;
+    size_t count, recsz;
+    unsigned height, width;
+};
+
+#define IMPORT_AT(im, i) ((im)->data + (i) * (im)->recsz)
+
+static uint32_t import_num(const struct import *im, size_t i)
+{
+    uint32_t num;
+    memcpy(&num, IMPORT_AT(im, i), sizeof(num));
+    return num;
+}
+
+static int import_comparison(const void *x, const void *y)
+{
+    uint32_t a, b;
+    memcpy(&a, x, sizeof(a));
+    memcpy(&b, y, sizeof(b));
+    return (a > b) - (a < b);
+}
+
+static void *import_record(struct import *im, size_t *capacity)
+{
+    if (im->count >= *capacity)
+    {
+        *capacity = *capacity ? *capacity * 2 : 256;
+        im->data = realloc(im->data, *capacity * im->recsz);
+    }
+
+    uint8_t *rec = IMPORT_AT(im, im->count++);
+    memset(rec, 0, im->recsz);
+    return rec;
+}
+
+static bool import_npf(FILE *fp, struct import *im, uint32_t first, uint32_t last)
+{
+    fseek(fp, 0, SEEK_END);
+    size_t filesz = ftell(fp);
+    rewind(fp);
+
+    if (filesz < sizeof(struct npf))
+    {
+        fprintf(stderr, "Datei ist zu klein.\n");
+        return false;
+    }
+
+    struct npf *npf = malloc(filesz);
+    if (fread(npf, 1, filesz, fp) != filesz)
+    {
+        fprintf(stderr, "Konnte Datei nicht lesen.\n");
+        free(npf);
+        return false;
+    }
+
+    if (strncmp(npf->sig, "NPF", 3))
+    {
+        fprintf(stderr, "Keine NPF-Datei.\n");
+        free(npf);
+        return false;
+    }
+
+    if ((npf->version != '2') && (npf->version != '3'))
+    {
+        fprintf(stderr, "Nicht unterstützte Version.\n");
+        free(npf);
+        return false;
+    }
+
+    if (npf->width > 8)
+    {
+        fprintf(stderr, "Schriftarten, die breiter als acht Pixel sind, werden nicht unterstützt.\n");
+        free(npf);
+        return false;
+    }
+
+    bool in_metrics = npf->version >= '3';
+    size_t rowsz = (npf->width + 7) / 8;
+    size_t in_charsz = npf->height * rowsz + sizeof(uint32_t) + (in_metrics ? sizeof(struct npf_metrics) : 0);
+
+    if ((filesz - sizeof(struct npf)) % in_charsz)
+    {
+        fprintf(stderr, "Ungültige Dateigröße (kein Vielfaches der Zeichengröße).\n");
+        free(npf);
+        return false;
+    }
+
+    im->height = npf->height;
+    im->width = npf->width;
+    im->recsz = sizeof(uint32_t) + im->height + 1;
+
+    size_t capacity = 0;
+    const uint8_t *c = (const uint8_t *)(npf + 1);
+    for (size_t i = 0; i < (filesz - sizeof(struct npf)) / in_charsz; i++, c += in_charsz)
+    {
+        const struct npf_char *ic = (const struct npf_char *)c;
+        if ((ic->num < first) || (ic->num > last))
+            continue;
+
+        uint8_t *rec = import_record(im, &capacity);
+        memcpy(rec, &ic->num, sizeof(uint32_t));
+        for (unsigned y = 0; y < im->height; y++)
+            rec[sizeof(uint32_t) + y] = ic->rows[y * rowsz];
+        rec[sizeof(uint32_t) + im->height] = in_metrics ? ((const struct npf_metrics *)&ic->rows[npf->height * rowsz])->advance
+                                                        : npf->width;
+    }
+
+    free(npf);
+    return true;
+}
+
+static bool import_bdf(FILE *fp, struct import *im, uint32_t first, uint32_t last)
+{
+    char buffer[1024];
+    int fw = 0, fh = 0, fx = 0, fy = 0;
+    int cw = 0, ch = 0, cx = 0, cy = 0, dw = 0;
+    long num = -1;
+    size_t capacity = 0;
+
+    while (fgets(buffer, sizeof(buffer), fp) != NULL)
+    {
+        char *cmd = strtok(buffer, " \n");
+        if (cmd == NULL)
+            continue;
+
+        if (!strcmp(cmd, "FONTBOUNDINGBOX"))
+        {
+            fw = atoi(strtok(NULL, " "));
+            fh = atoi(strtok(NULL, " "));
+            fx = atoi(strtok(NULL, " "));
+            fy = atoi(strtok(NULL, " "));
 
-    strncpy(fname, npf->name, 24);
+            if ((fw <= 0) || (fh <= 0) || (fh > 255))
+            {
+                fprintf(stderr, "Ungültige Zeichengröße.\n");
+                return false;
+            }
 
-    free(npf);
+            if (fw > 8)
+            {
+                fprintf(stderr, "Schriftarten, die breiter als acht Pixel sind, werden nicht unterstützt.\n");
+                return false;
+            }
 
-    printf("%u×%u-Schriftart „%s“ geladen.\n", width, height, fname);
+            im->height = fh;
+            im->width = fw;
+            im->recsz = sizeof(uint32_t) + im->height + 1;
+        }
+        else if (!strcmp(cmd, "STARTCHAR"))
+        {
+            num = -1;
+            dw = fw;
+        }
+        else if (!strcmp(cmd, "ENCODING"))
+            num = atol(strtok(NULL, " "));
+        else if (!strcmp(cmd, "DWIDTH"))
+            dw = atoi(strtok(NULL, " "));
+        else if (!strcmp(cmd, "BBX"))
+        {
+            cw = atoi(strtok(NULL, " "));
+            ch = atoi(strtok(NULL, " "));
+            cx = atoi(strtok(NULL, " "));
+            cy = atoi(strtok(NULL, " "));
+        }
+        else if (!strcmp(cmd, "BITMAP"))
+        {
+            if (!im->recsz)
+            {
+                fprintf(stderr, "FONTBOUNDINGBOX fehlt.\n");
+                return false;
+            }
 
-    return true;
-}
+            bool wanted = (num >= (long)first) && (num <= (long)last);
+            uint8_t *rec = NULL;
+            if (wanted)
+            {
+                rec = import_record(im, &capacity);
+                uint32_t n = num;
+                memcpy(rec, &n, sizeof(n));
+                rec[sizeof(uint32_t) + im->height] = (dw < 0) ? 0 : (dw > UINT8_MAX) ? UINT8_MAX : dw;
+            }
 
-static void save_font(const char *fpname)
-{
-    FILE *fp = fopen(fpname, "wb");
-    if (fp == NULL)
-    {
-        perror("Konnte die Datei nicht erstellen");
-        return;
+            // Pixel außerhalb der Zelle werden verworfen
+            int bx = cx - fx, by = fh - (ch + cy) + fy;
+            for (int i = 0; i < ch; i++)
+            {
+                if (fgets(buffer, sizeof(buffer), fp) == NULL)
+                    break;
+                if (!wanted || (by + i < 0) || (by + i >= fh))
+                    continue;
+
+                char byte[3] = { buffer[0], buffer[0] ? buffer[1] : 0, 0 };
+                unsigned bits = strtoul(byte, NULL, 16);
+                for (int rx = 0; (rx < cw) && (rx < 8); rx++)
+                    if ((bits & (0x80 >> rx)) && (bx + rx >= 0) && (bx + rx < 8))
+                        rec[sizeof(uint32_t) + by + i] |= 1 << (bx + rx);
+            }
+        }
     }
 
-    struct npf npf = {
-        .sig = "NPF",
-        .version = '2',
-        .width = width,
-        .height = height
-    };
-    memcpy(npf.name, fname, 24);
-
-    fwrite(&npf, 1, sizeof(npf), fp);
-    fwrite(char_array, chars, charsz, fp);
+    if (!im->recsz)
+    {
+        fprintf(stderr, "Keine BDF-Datei.\n");
+        return false;
+    }
 
-    fclose(fp);
+    return true;
 }
 
-static struct npf_char *get_char(uint32_t unicode)
+// Überträgt ein importiertes Zeichen in c, bei abweichender Höhe per
+// Nächster-Nachbar-Skalierung der Zeilen
+static void import_rows(struct npf_char *c, const struct import *im, const uint8_t *rec)
 {
-    if (!font_valid || !chars)
-        return NULL;
-
-    struct npf_char *c = char_array;
-    for (size_t i = 0; (i < chars) && (c->num != unicode); i++)
-        c = (struct npf_char *)((uintptr_t)c + charsz);
+    uint8_t mask = (1 << width) - 1;
+    for (unsigned y = 0; y < height; y++)
+        c->rows[y] = rec[sizeof(uint32_t) + y * im->height / height] & mask;
 
-    if (c->num == unicode)
-        return c;
-    return NULL;
+    struct npf_metrics *m = char_metrics(c);
+    if (m != NULL)
+        m->advance = rec[sizeof(uint32_t) + im->height];
+    update_ink(c);
 }
 
-static void add_char(uint32_t unicode, uint32_t uni_src)
+// Fügt die (sortierten) Zeichen aus src hinten beginnend in die sortierte
+// Tabelle *array ein, in einem Durchgang und ohne Zwischenpuffer
+static void merge_chars(struct npf_char **array, size_t *count, const struct npf_char *src, size_t n)
 {
-    if (!font_valid)
-    {
-        fprintf(stderr, "Keine Schriftart aktiv.\n");
-        return;
-    }
+    *array = realloc(*array, (*count + n) * charsz);
 
-    if (get_char(unicode) != NULL)
-    {
-        fprintf(stderr, "Zeichen existiert bereits.\n");
-        return;
-    }
-
-    struct npf_char *src = NULL;
-    if (uni_src)
+    size_t i = *count, k = n, w = *count + n;
+    while (k)
     {
-        src = get_char(uni_src);
-        if (src == NULL)
-        {
-            fprintf(stderr, "Quellzeichen nicht gefunden.\n");
-            return;
-        }
+        if (i && (CHAR_IN(*array, i - 1)->num > CHAR_IN(src, k - 1)->num))
+            memcpy(CHAR_IN(*array, --w), CHAR_IN(*array, --i), charsz);
+        else
+            memcpy(CHAR_IN(*array, --w), CHAR_IN(src, --k), charsz);
     }
 
-    char_array = realloc(char_array, ++chars * charsz);
-    struct npf_char *c = (struct npf_char *)((uintptr_t)char_array + (chars - 1) * charsz);
-    c->num = unicode;
-
-    if (src == NULL)
-        memset(c->rows, 0, charsz - sizeof(uint32_t));
-    else
-        memcpy(c->rows, src->rows, charsz - sizeof(uint32_t));
-
-    printf("Zeichen %lc (U+0x%04X) hinzugefügt.\n", (wint_t)unicode, (unsigned)unicode);
+    *count += n;
 }
 
-static void remove_char(uint32_t unicode)
+static void import_chars(const char *name, uint32_t first, uint32_t last, bool overwrite)
 {
     if (!font_valid)
     {
@@ -176,125 +1633,91 @@ static void remove_char(uint32_t unicode)
         return;
     }
 
-    struct npf_char *c;
-    if ((c = get_char(unicode)) == NULL)
+    FILE *fp = fopen(name, "rb");
+    if (fp == NULL)
     {
-        fprintf(stderr, "Zeichen nicht gefunden.\n");
+        perror("Konnte Datei nicht öffnen");
         return;
     }
 
-    memmove(c, (const void *)((uintptr_t)c + charsz), (--chars * charsz) - ((uintptr_t)c - (uintptr_t)char_array));
+    char sig[3] = { 0 };
+    fread(sig, 1, sizeof(sig), fp);
+    rewind(fp);
 
-    printf("Zeichen %lc (U+0x%04X) entfernt.\n", (wint_t)unicode, (unsigned)unicode);
-}
+    struct import im = { 0 };
+    bool ok = !strncmp(sig, "NPF", 3) ? import_npf(fp, &im, first, last) : import_bdf(fp, &im, first, last);
+    fclose(fp);
 
-static void show_char(uint32_t unicode)
-{
-    struct npf_char *c = get_char(unicode);
-    if (c == NULL)
+    if (!ok)
     {
-        fprintf(stderr, "Zeichen nicht gefunden.\n");
+        free(im.data);
         return;
     }
 
-    for (unsigned y = 0; y < height; y++)
+    for (size_t i = 1; i < im.count; i++)
     {
-        for (unsigned x = 0; x < width; x++)
-            printf("%s", (c->rows[y] & (1 << x)) ? "█" : "·");
-        putchar('\n');
+        if (import_num(&im, i - 1) > import_num(&im, i))
+        {
+            qsort(im.data, im.count, im.recsz, import_comparison);
+            break;
+        }
     }
-}
 
-static void edit_char(uint32_t unicode)
-{
-    struct npf_char *c = get_char(unicode);
-    if (c == NULL)
-    {
-        fprintf(stderr, "Zeichen nicht gefunden.\n");
-        return;
-    }
+    // Ein Durchgang über die importierten Zeichen und parallel dazu über
+    // char_array und overlay: Vorhandene Zeichen werden direkt überschrieben
+    // (oder übersprungen), neue gesammelt und danach eingemischt
+    check_mapped_order();
 
-    show_char(unicode);
+    struct npf_char *added = malloc((im.count ? im.count : 1) * charsz);
+    size_t added_chars = 0, replaced = 0, skipped = 0;
+    size_t bi = 0, oi = 0;
 
-    printf("Gib neues Zeichen mit Raute (#) und Leerzeichen ( ) ein:\n");
-    printf("(x, um das letzte Zeichen zu löschen; l, um zur letzten Zeile zurückzugehen; n, um die Zeile nicht zu verändern)\n");
+    for (size_t k = 0; k < im.count; k++)
+    {
+        uint32_t num = import_num(&im, k);
+        if (k && (import_num(&im, k - 1) == num))
+            continue;
 
-    char tbuf[height];
-    memcpy(tbuf, c->rows, height);
+        while ((bi < chars) && (CHAR_AT(sorted_index(bi))->num < num))
+            bi++;
+        while ((oi < overlay_chars) && (CHAR_IN(overlay, oi)->num < num))
+            oi++;
 
-    struct termios old_tio, new_tio;
-    tcgetattr(0, &old_tio);
-    new_tio = old_tio;
-    new_tio.c_lflag &= ~ICANON;
-    tcsetattr(0, TCSANOW, &new_tio);
+        struct npf_char *c = NULL;
+        if ((bi < chars) && (CHAR_AT(sorted_index(bi))->num == num) && !is_removed(sorted_index(bi)))
+            c = CHAR_AT(sorted_index(bi));
+        else if ((oi < overlay_chars) && (CHAR_IN(overlay, oi)->num == num))
+            c = CHAR_IN(overlay, oi);
 
-    for (unsigned y = 0; y < height; y++)
-    {
-        printf("[%02i] ", y);
-        for (unsigned x = 0; x < width; x++)
+        if (c == NULL)
         {
-            recol:
-
-            switch (getchar())
-            {
-                case '#':
-                    tbuf[y] |= 1 << x;
-                    break;
-                case ' ':
-                    tbuf[y] &= ~(1 << x);
-                    break;
-                case 'x':
-                    if (!x)
-                        printf("\b \b");
-                    else
-                    {
-                        x--;
-                        printf("\b\b  \b\b");
-                    }
-                    goto recol;
-                case 'l':
-                    if (y)
-                        printf("\r[%02i] ", --y);
-                    x = 0;
-                    goto recol;
-                case 'n':
-                    putchar('\b');
-                    for (; x < width; x++)
-                        putchar((tbuf[y] & (1 << x)) ? '#' : ' ');
-                    break;
-                default:
-                    fprintf(stderr, "Ungültige Eingabe. Abbruch.\n");
-                    return;
-            }
+            c = CHAR_IN(added, added_chars++);
+            c->num = num;
+            import_rows(c, &im, IMPORT_AT(&im, k));
+            undo_record(num, UNDO_ADD, c->rows, charsz - sizeof(uint32_t));
         }
-
-        putchar('\n');
+        else if (overwrite)
+        {
+            char before[charsz - sizeof(uint32_t)];
+            memcpy(before, c->rows, sizeof(before));
+            import_rows(c, &im, IMPORT_AT(&im, k));
+            undo_record_rows(c, before);
+            replaced++;
+        }
+        else
+            skipped++;
     }
 
-    tcsetattr(0, TCSANOW, &old_tio);
-
-    memcpy(c->rows, tbuf, height);
-}
+    if (mapped != NULL)
+        merge_chars(&overlay, &overlay_chars, added, added_chars);
+    else
+        merge_chars(&char_array, &chars, added, added_chars);
 
-static void move_char(uint32_t unicode, int y)
-{
-    struct npf_char *c = get_char(unicode);
-    if (c == NULL)
-    {
-        fprintf(stderr, "Zeichen nicht gefunden.\n");
-        return;
-    }
+    free(added);
+    free(im.data);
 
-    if (y > 0)
-    {
-        memmove(&c->rows[y], c->rows, height - y);
-        memset(c->rows, 0, y);
-    }
-    else
-    {
-        memmove(c->rows, &c->rows[-y], height + y);
-        memset(&c->rows[height + y], 0, -y);
-    }
+    printf("%zu Zeichen hinzugefügt, %zu ersetzt, %zu übersprungen (Quelle %u×%u).\n",
+           added_chars, replaced, skipped, im.width, im.height);
 }
 
 static wchar_t read_opt_utf8_par(void)
@@ -343,14 +1766,15 @@ static unsigned long read_number_par(void)
     return (unsigned long)-1;
 }
 
-static int npf_char_comparison(const void *x, const void *y)
-{
-    return (int32_t)(*(struct npf_char **)x)->num - (int32_t)(*(struct npf_char **)y)->num;
-}
-
 int main(int argc, char *argv[])
 {
-    if (argc >= 2)
+    if ((argc >= 3) && !strcmp(argv[1], "-m"))
+    {
+        if (!map_font((cf = strdup(argv[2]))))
+            return 1;
+        font_valid = true;
+    }
+    else if (argc >= 2)
     {
         cf = argv[1];
         if (!load_font((cf = strdup(argv[1]))))
@@ -373,12 +1797,17 @@ int main(int argc, char *argv[])
             continue;
         }
 
+        // Alles, was ein Befehl ändert, wird gemeinsam rückgängig gemacht
+        undo_new_group = true;
+
         if (!strcmp(cmd, "help"))
         {
             printf("Befehle:\n");
             printf(" - help: Zeigt diese Liste an\n");
             printf(" - quit: Beendet das Programm\n");
             printf(" - open <Datei>: Lädt die angegebene Datei\n");
+            printf(" - map <Datei>: Öffnet die angegebene (sortierte) Datei zur direkten Bearbeitung; Änderungen an\n");
+            printf("                bestehenden Zeichen werden sofort übernommen, neue und gelöschte beim Speichern.\n");
             printf(" - new: Erstellt eine neue Schriftart\n");
             printf(" - save [Datei]: Schreibt in die angegebene Datei, oder, wenn keine angegeben wurde, in die\n");
             printf("                 zuletzt geladene.\n");
@@ -396,13 +1825,22 @@ int main(int argc, char *argv[])
             printf(" - moveun <Unicode>: Schiebt ein Zeichen eine Zeile nach oben.\n");
             printf(" - show <Zeichen>: Zeigt ein Zeichen an.\n");
             printf(" - shown <Unicode>: Zeigt ein Zeichen an.\n");
+            printf(" - similar <Zeichen> [Anzahl]: Sucht die (standardmäßig zehn) ähnlichsten Zeichen.\n");
+            printf(" - similarn <Unicode> [Anzahl]: Sucht die (standardmäßig zehn) ähnlichsten Zeichen.\n");
+            printf(" - advance <Zeichen> <Pixel>: Setzt den Vorschub eines Zeichens.\n");
+            printf(" - advancen <Unicode> <Pixel>: Setzt den Vorschub eines Zeichens.\n");
+            printf(" - import <Datei> [Bereich] [--overwrite]: Übernimmt Zeichen aus einer NPF- oder BDF-Datei\n");
+            printf("                 (Bereich z. B. 0x400-0x4FF); vorhandene werden nur mit --overwrite ersetzt.\n");
+            printf(" - undo: Macht den letzten Befehl rückgängig.\n");
+            printf(" - redo: Stellt den zuletzt rückgängig gemachten Befehl wieder her.\n");
+            printf(" - grid [Zeichen]: Zeigt eine Seite voller Zeichen an (ohne Parameter die nächste Seite).\n");
+            printf(" - gridn <Unicode>: Zeigt eine Seite voller Zeichen ab dem angegebenen Code an.\n");
         }
         else if (!strcmp(cmd, "quit") || !strcmp(cmd, "exit"))
             break;
         else if (!strcmp(cmd, "open"))
         {
-            if (font_valid)
-                free(char_array);
+            close_font();
             if (cf != NULL)
                 free((char *)cf);
 
@@ -410,6 +1848,24 @@ int main(int argc, char *argv[])
             if ((font_valid = load_font(cf)))
                 cf = NULL;
         }
+        else if (!strcmp(cmd, "map"))
+        {
+            const char *f = strtok(NULL, " ");
+            if (f == NULL)
+            {
+                free(inp);
+                fprintf(stderr, "Kein Name angegeben.\n");
+                continue;
+            }
+
+            close_font();
+            if (cf != NULL)
+                free((char *)cf);
+
+            cf = NULL;
+            if ((font_valid = map_font(f)))
+                cf = strdup(f);
+        }
         else if (!strcmp(cmd, "save"))
         {
             if (!font_valid)
@@ -432,12 +1888,14 @@ int main(int argc, char *argv[])
             else if (cf == NULL)
                 cf = strdup(f);
 
-            save_font(f);
+            if (mapped != NULL)
+                save_mapped_font(f);
+            else
+                save_font(f);
         }
         else if (!strcmp(cmd, "new"))
         {
-            if (font_valid)
-                free(char_array);
+            close_font();
 
             cf = NULL;
             font_valid = false;
@@ -491,7 +1949,9 @@ int main(int argc, char *argv[])
 
             char_array = NULL;
             chars = 0;
-            charsz = height + sizeof(uint32_t);
+            grid_next = 0;
+            has_metrics = true;
+            charsz = height + sizeof(uint32_t) + sizeof(struct npf_metrics);
 
             font_valid = true;
         }
@@ -512,29 +1972,39 @@ int main(int argc, char *argv[])
                 fprintf(stderr, "Ungültige Eingabe.\n");
                 continue;
             }
+            char old_name[24];
+            memcpy(old_name, fname, 24);
+
             strncpy(fname, tinp, 24);
             size_t i;
             for (i = 0; (i < 24) && fname[i]; i++);
             while (i < 24)
                 fname[i++] = ' ';
+
+            for (i = 0; i < 24; i++)
+                old_name[i] ^= fname[i];
+            undo_record(0, UNDO_NAME, old_name, 24);
+
+            if (mapped != NULL)
+                memcpy(mapped->name, fname, 24);
         }
         else if (!strcmp(cmd, "list"))
+            list_chars();
+        else if (!strcmp(cmd, "grid"))
         {
-            struct npf_char *tc = char_array;
-
-            struct npf_char **sorted = malloc(sizeof(*sorted) * chars);
-            for (size_t i = 0; i < chars; i++)
+            wchar_t wc = read_opt_utf8_par();
+            if (wc)
+                grid_next = wc;
+            show_grid();
+        }
+        else if (!strcmp(cmd, "gridn"))
+        {
+            unsigned long n = read_number_par();
+            if (n != (unsigned long)-1)
             {
-                sorted[i] = tc;
-                tc = (struct npf_char *)((uintptr_t)tc + charsz);
+                grid_next = n;
+                show_grid();
             }
-
-            qsort(sorted, chars, sizeof(*sorted), npf_char_comparison);
-
-            for (size_t i = 0; i < chars; i++)
-                printf("%lc (U+0x%04X)\n", (wint_t)sorted[i]->num, (unsigned)sorted[i]->num);
-
-            free(sorted);
         }
         else if (!strcmp(cmd, "add"))
         {
@@ -599,6 +2069,93 @@ int main(int argc, char *argv[])
             if (n != (unsigned long)-1)
                 move_char(n, -1);
         }
+        else if (!strcmp(cmd, "advance"))
+        {
+            wchar_t wc = read_utf8_par();
+            if (wc)
+            {
+                unsigned long adv = read_number_par();
+                if (adv != (unsigned long)-1)
+                    set_advance(wc, adv);
+            }
+        }
+        else if (!strcmp(cmd, "advancen"))
+        {
+            unsigned long n = read_number_par();
+            if (n != (unsigned long)-1)
+            {
+                unsigned long adv = read_number_par();
+                if (adv != (unsigned long)-1)
+                    set_advance(n, adv);
+            }
+        }
+        else if (!strcmp(cmd, "similar") || !strcmp(cmd, "similarn"))
+        {
+            unsigned long n;
+            if (cmd[7] == 'n')
+                n = read_number_par();
+            else
+            {
+                wchar_t wc = read_utf8_par();
+                n = wc ? (unsigned long)wc : (unsigned long)-1;
+            }
+
+            if (n != (unsigned long)-1)
+            {
+                unsigned long k = 10;
+                char *tmp = strtok(NULL, " ");
+                if (tmp != NULL)
+                {
+                    k = strtoul(tmp, &tmp, 0);
+                    if (*tmp || !k)
+                    {
+                        fprintf(stderr, "Ungültige Anzahl.\n");
+                        k = 0;
+                    }
+                }
+
+                if (k)
+                    find_similar(n, k);
+            }
+        }
+        else if (!strcmp(cmd, "undo"))
+            undo();
+        else if (!strcmp(cmd, "redo"))
+            redo();
+        else if (!strcmp(cmd, "import"))
+        {
+            const char *f = strtok(NULL, " ");
+            if (f == NULL)
+            {
+                free(inp);
+                fprintf(stderr, "Kein Name angegeben.\n");
+                continue;
+            }
+
+            uint32_t first = 0, last = UINT32_MAX;
+            bool overwrite = false, valid = true;
+            for (char *par = strtok(NULL, " "); valid && (par != NULL); par = strtok(NULL, " "))
+            {
+                if (!strcmp(par, "--overwrite"))
+                {
+                    overwrite = true;
+                    continue;
+                }
+
+                char *tmp;
+                first = last = strtoul(par, &tmp, 0);
+                if (*tmp == '-')
+                    last = strtoul(tmp + 1, &tmp, 0);
+                if (*tmp || (tmp == par) || (last < first))
+                {
+                    fprintf(stderr, "Ungültiger Bereich.\n");
+                    valid = false;
+                }
+            }
+
+            if (valid)
+                import_chars(f, first, last, overwrite);
+        }
         else if (!strcmp(cmd, "show"))
         {
             wchar_t wc = read_utf8_par();
@@ -0,0 +1,392 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct npf
+{
+    char sig[3], version;
+    uint16_t height, width;
+    char name[24];
+} __attribute__((packed));
+
+struct npf_char
+{
+    uint32_t num;
+    uint8_t rows[];
+} __attribute__((packed));
+
+// Ab Version 3 folgen jedem Zeichen hinter den Zeilen seine Metriken
+struct npf_metrics
+{
+    uint8_t advance;
+    uint8_t ink_x, ink_y, ink_w, ink_h;
+} __attribute__((packed));
+
+struct bmp_header
+{
+    char type[2];
+    uint32_t sz, rsvd;
+    uint32_t offset;
+} __attribute__((packed));
+
+struct bmp_info
+{
+    uint32_t size;
+    int32_t width, height;
+    uint16_t planes, bpp;
+    uint32_t compression, sz;
+    int32_t xdpm, ydpm;
+    uint32_t clr_used, clr_important;
+} __attribute__((packed));
+
+// Binäre UV-Tabelle: Kopf, dann ein Eintrag je Zeichen (nach Code sortiert)
+struct npf_atlas
+{
+    char sig[3], version;
+    uint32_t entries;
+    uint16_t width, height;
+} __attribute__((packed));
+
+struct npf_atlas_entry
+{
+    uint32_t num;
+    uint16_t x, y, w, h;
+    uint16_t xoff, yoff, advance, rsvd;
+} __attribute__((packed));
+
+struct glyph
+{
+    const struct npf_char *chr;
+    struct npf_atlas_entry e;
+};
+
+// Abstand zwischen den Zeichen, damit beim Filtern nichts hinüberblutet
+#define ATLAS_GAP 1
+
+static unsigned fw, fh;
+static size_t rowsz;
+
+static int glyph_num_comparison(const void *x, const void *y)
+{
+    uint32_t a = ((const struct glyph *)x)->e.num, b = ((const struct glyph *)y)->e.num;
+    return (a > b) - (a < b);
+}
+
+// Höhere Zeichen zuerst, damit die Regale möglichst gleichmäßig gefüllt werden
+static int glyph_size_comparison(const void *x, const void *y)
+{
+    const struct npf_atlas_entry *a = &((const struct glyph *)x)->e, *b = &((const struct glyph *)y)->e;
+    if (a->h != b->h)
+        return (int)b->h - (int)a->h;
+    if (a->w != b->w)
+        return (int)b->w - (int)a->w;
+    return (a->num > b->num) - (a->num < b->num);
+}
+
+static bool pixel(const struct npf_char *c, unsigned x, unsigned y)
+{
+    return c->rows[y * rowsz + x / 8] & (1 << (x % 8));
+}
+
+static void ink_bounds(struct npf_atlas_entry *e, const struct npf_char *c)
+{
+    unsigned x0 = fw, x1 = 0, y0 = fh, y1 = 0;
+
+    for (unsigned y = 0; y < fh; y++)
+    {
+        for (unsigned x = 0; x < fw; x++)
+        {
+            if (pixel(c, x, y))
+            {
+                x0 = (x < x0) ? x : x0;
+                x1 = (x + 1 > x1) ? x + 1 : x1;
+                y0 = (y < y0) ? y : y0;
+                y1 = y + 1;
+            }
+        }
+    }
+
+    if (x1 > x0)
+    {
+        e->xoff = x0;
+        e->yoff = y0;
+        e->w = x1 - x0;
+        e->h = y1 - y0;
+    }
+    else
+        e->xoff = e->yoff = e->w = e->h = 0;
+}
+
+int main(int argc, char *argv[])
+{
+    bool trim = false, json = false;
+    unsigned atlas_w = 0;
+
+    while ((argc > 1) && (argv[1][0] == '-'))
+    {
+        if (!strcmp(argv[1], "-t"))
+            trim = true;
+        else if (!strcmp(argv[1], "-j"))
+            json = true;
+        else if (!strcmp(argv[1], "-w") && (argc > 2))
+        {
+            char *tmp;
+            atlas_w = strtoul(argv[2], &tmp, 0);
+            if (*tmp || !atlas_w || (atlas_w > UINT16_MAX))
+            {
+                fprintf(stderr, "Ungültige Breite.\n");
+                return 1;
+            }
+            argc--;
+            argv++;
+        }
+        else
+        {
+            fprintf(stderr, "Unbekannte Option „%s“.\n", argv[1]);
+            return 1;
+        }
+
+        argc--;
+        argv++;
+    }
+
+    if (argc < 4)
+    {
+        fprintf(stderr, "Benutzung: npf2atlas [-t] [-j] [-w <Breite>] <npf> <bmp> <Tabelle>\n");
+        fprintf(stderr, " -t: Zeichen auf ihren gesetzten Bereich zuschneiden\n");
+        fprintf(stderr, " -j: Tabelle als JSON statt binär schreiben\n");
+        fprintf(stderr, " -w: Breite des Atlas (sonst ungefähr quadratisch)\n");
+        return 1;
+    }
+
+    FILE *npf = fopen(argv[1], "rb");
+    if (npf == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    fseek(npf, 0, SEEK_END);
+    size_t filesz = ftell(npf);
+    rewind(npf);
+
+    if (filesz < sizeof(struct npf))
+    {
+        fprintf(stderr, "Datei ist zu klein.\n");
+        return 1;
+    }
+
+    struct npf *npfh = malloc(filesz);
+    fread(npfh, filesz, 1, npf);
+    fclose(npf);
+
+    if (strncmp(npfh->sig, "NPF", 3))
+    {
+        fprintf(stderr, "Keine NPF-Datei.\n");
+        return 1;
+    }
+
+    if ((npfh->version != '2') && (npfh->version != '3'))
+    {
+        fprintf(stderr, "Nicht unterstützte Version.\n");
+        return 1;
+    }
+
+    bool has_metrics = npfh->version >= '3';
+    fw = npfh->width;
+    fh = npfh->height;
+    rowsz = (fw + 7) / 8;
+    size_t charsz = fh * rowsz + sizeof(uint32_t) + (has_metrics ? sizeof(struct npf_metrics) : 0);
+
+    if ((filesz - sizeof(struct npf)) % charsz)
+    {
+        fprintf(stderr, "Ungültige Dateigröße (kein Vielfaches der Zeichengröße).\n");
+        return 1;
+    }
+
+    unsigned chars = (filesz - sizeof(struct npf)) / charsz;
+    struct glyph *g = calloc(chars, sizeof(*g));
+
+    uint64_t area = 0;
+    unsigned max_w = 1;
+
+    const struct npf_char *c = (const struct npf_char *)(npfh + 1);
+    for (unsigned ci = 0; ci < chars; ci++)
+    {
+        g[ci].chr = c;
+        g[ci].e.num = c->num;
+        g[ci].e.advance = fw;
+
+        const struct npf_metrics *m = has_metrics ? (const struct npf_metrics *)&c->rows[fh * rowsz] : NULL;
+        if (m != NULL)
+            g[ci].e.advance = m->advance;
+
+        if (!trim)
+        {
+            g[ci].e.w = fw;
+            g[ci].e.h = fh;
+        }
+        // Metriken, die über die Zelle hinausreichen (beschädigte Datei),
+        // werden nicht übernommen, sondern neu bestimmt
+        else if ((m != NULL) && (m->ink_x + m->ink_w <= fw) && (m->ink_y + m->ink_h <= fh))
+        {
+            g[ci].e.xoff = m->ink_x;
+            g[ci].e.yoff = m->ink_y;
+            g[ci].e.w = m->ink_w;
+            g[ci].e.h = m->ink_h;
+        }
+        else
+            ink_bounds(&g[ci].e, c);
+
+        if (!g[ci].e.w || !g[ci].e.h)
+            g[ci].e.w = g[ci].e.h = 0;
+
+        area += (uint64_t)(g[ci].e.w + ATLAS_GAP) * (g[ci].e.h + ATLAS_GAP);
+        if (g[ci].e.w > max_w)
+            max_w = g[ci].e.w;
+
+        c = (const struct npf_char *)((uintptr_t)c + charsz);
+    }
+
+    if (!atlas_w)
+        atlas_w = ceil(sqrt((double)area) * 1.05);
+    if (atlas_w < max_w)
+        atlas_w = max_w;
+    if (atlas_w > UINT16_MAX)
+        atlas_w = UINT16_MAX;
+
+    // Regalpacker: Zeichen absteigend nach Höhe von links nach rechts in
+    // Regale legen; passt eins nicht mehr, beginnt darunter ein neues Regal
+    qsort(g, chars, sizeof(*g), glyph_size_comparison);
+
+    unsigned shelf_x = 0, shelf_y = 0, shelf_h = 0;
+    for (unsigned i = 0; i < chars; i++)
+    {
+        if (!g[i].e.w)
+            continue;
+
+        if (shelf_x + g[i].e.w > atlas_w)
+        {
+            shelf_y += shelf_h + ATLAS_GAP;
+            shelf_x = shelf_h = 0;
+        }
+
+        g[i].e.x = shelf_x;
+        g[i].e.y = shelf_y;
+        shelf_x += g[i].e.w + ATLAS_GAP;
+        if (g[i].e.h > shelf_h)
+            shelf_h = g[i].e.h;
+    }
+
+    unsigned atlas_h = shelf_y + shelf_h;
+    if (!atlas_h)
+        atlas_h = 1;
+
+    if (atlas_h > UINT16_MAX)
+    {
+        fprintf(stderr, "Atlas wäre zu hoch, bitte eine größere Breite angeben.\n");
+        return 1;
+    }
+
+    // Graustufenbild mit 8 Bit je Pixel: 255 für gesetzte Pixel, sonst 0
+    size_t line_length = (atlas_w + 3) & ~3;
+    uint8_t *img = calloc(line_length, atlas_h);
+
+    for (unsigned i = 0; i < chars; i++)
+    {
+        const struct npf_atlas_entry *e = &g[i].e;
+        for (unsigned y = 0; y < e->h; y++)
+        {
+            uint8_t *dst = img + (e->y + y) * line_length + e->x;
+            for (unsigned x = 0; x < e->w; x++)
+                if (pixel(g[i].chr, e->xoff + x, e->yoff + y))
+                    dst[x] = 0xFF;
+        }
+    }
+
+    FILE *bmp = fopen(argv[2], "wb");
+    if (bmp == NULL)
+    {
+        perror(argv[2]);
+        return 1;
+    }
+
+    struct bmp_header bmph = {
+        .type = "BM",
+        .sz = sizeof(struct bmp_header) + sizeof(struct bmp_info) + 256 * 4 + line_length * atlas_h,
+        .offset = sizeof(struct bmp_header) + sizeof(struct bmp_info) + 256 * 4
+    };
+
+    struct bmp_info bmpi = {
+        .size = sizeof(bmpi),
+        .width = atlas_w,
+        .height = -(int32_t)atlas_h,
+        .planes = 1,
+        .bpp = 8,
+        .compression = 0,
+        .sz = line_length * atlas_h,
+        .clr_used = 256
+    };
+
+    uint8_t palette[256 * 4];
+    for (unsigned i = 0; i < 256; i++)
+    {
+        palette[i * 4] = palette[i * 4 + 1] = palette[i * 4 + 2] = i;
+        palette[i * 4 + 3] = 0;
+    }
+
+    fwrite(&bmph, sizeof(bmph), 1, bmp);
+    fwrite(&bmpi, sizeof(bmpi), 1, bmp);
+    fwrite(palette, sizeof(palette), 1, bmp);
+    fwrite(img, line_length, atlas_h, bmp);
+    fclose(bmp);
+
+    qsort(g, chars, sizeof(*g), glyph_num_comparison);
+
+    FILE *tab = fopen(argv[3], "wb");
+    if (tab == NULL)
+    {
+        perror(argv[3]);
+        return 1;
+    }
+
+    if (json)
+    {
+        fprintf(tab, "{\"width\":%u,\"height\":%u,\"cell_width\":%u,\"cell_height\":%u,\"glyphs\":[", atlas_w, atlas_h, fw, fh);
+        for (unsigned i = 0; i < chars; i++)
+        {
+            const struct npf_atlas_entry *e = &g[i].e;
+            fprintf(tab, "%s\n{\"cp\":%u,\"x\":%u,\"y\":%u,\"w\":%u,\"h\":%u,\"xoff\":%u,\"yoff\":%u,\"advance\":%u}",
+                    i ? "," : "", (unsigned)e->num, e->x, e->y, e->w, e->h, e->xoff, e->yoff, e->advance);
+        }
+        fputs("\n]}\n", tab);
+    }
+    else
+    {
+        struct npf_atlas hdr = {
+            .sig = "NPA",
+            .version = '1',
+            .entries = chars,
+            .width = atlas_w,
+            .height = atlas_h
+        };
+
+        fwrite(&hdr, sizeof(hdr), 1, tab);
+        for (unsigned i = 0; i < chars; i++)
+            fwrite(&g[i].e, sizeof(g[i].e), 1, tab);
+    }
+
+    fclose(tab);
+
+    printf("%u Zeichen in %u×%u-Atlas gepackt (%.1f %% belegt).\n", chars, atlas_w, atlas_h,
+           100.0 * area / ((double)atlas_w * atlas_h));
+
+    free(img);
+    free(g);
+    free(npfh);
+
+    return 0;
+}
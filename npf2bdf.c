@@ -1,8 +1,14 @@
+#define _DEFAULT_SOURCE
+
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "cache.h"
+#include "stream.h"
+
 struct npf
 {
     char sig[3], version;
@@ -16,83 +22,423 @@ struct npf_char
     uint8_t rows[];
 } __attribute__((packed));
 
-int main(int argc, char *argv[])
+// Ab Version 3 folgen jedem Zeichen hinter den Zeilen seine Metriken
+struct npf_metrics
 {
-    if (argc < 3)
+    uint8_t advance;
+    uint8_t ink_x, ink_y, ink_w, ink_h;
+} __attribute__((packed));
+
+static bool has_metrics;
+
+// Metriken eines Zeichens; ohne gespeicherte Metriken füllt jedes Zeichen
+// seine Zelle aus.
+// Metriken, die über die Zelle hinausreichen (beschädigte Datei), werden
+// durch die ganze Zelle ersetzt, damit niemand außerhalb der Zeilen liest
+static struct npf_metrics char_metrics(const struct npf_char *c, unsigned fw, unsigned fh)
+{
+    if (!has_metrics)
+        return (struct npf_metrics){ .advance = fw, .ink_w = fw, .ink_h = fh };
+
+    struct npf_metrics m = *(const struct npf_metrics *)&c->rows[fh];
+    if ((m.ink_x + m.ink_w > fw) || (m.ink_y + m.ink_h > fh))
     {
-        fprintf(stderr, "Benutzung: npf2bdf <npf> <bdf>\n");
-        return 1;
+        m.ink_x = m.ink_y = 0;
+        m.ink_w = fw;
+        m.ink_h = fh;
     }
+    return m;
+}
 
-    FILE *npf = fopen(argv[1], "rb");
-    if (npf == NULL)
+// Liefert den SPACING-Wert und die durchschnittliche Breite in Zehntelpixeln
+static char font_spacing(const struct npf_char *char_array, unsigned chars, size_t charsz, unsigned fw, unsigned fh, unsigned *avg_width)
+{
+    if (!has_metrics)
     {
-        perror(argv[1]);
-        return 1;
+        *avg_width = 60;
+        return 'C';
     }
 
-    FILE *bdf = fopen(argv[2], "wb");
-    if (bdf == NULL)
+    bool proportional = false;
+    unsigned long sum = 0;
+
+    const struct npf_char *c = char_array;
+    for (unsigned ci = 0; ci < chars; ci++)
     {
-        perror(argv[2]);
-        return 1;
+        unsigned adv = char_metrics(c, fw, fh).advance;
+        proportional |= adv != fw;
+        sum += adv;
+        c = (const struct npf_char *)((uintptr_t)c + charsz);
     }
 
-    fseek(npf, 0, SEEK_END);
-    size_t filesz = ftell(npf);
-    rewind(npf);
+    *avg_width = chars ? sum * 10 / chars : fw * 10;
+    return proportional ? 'P' : 'C';
+}
+
+// PCF-Ausgabe (binäres X11-Schriftformat). Alle Tabellen werden mit
+// niederwertigem Byte und Bit zuerst und auf vier Bytes aufgefüllten Zeilen
+// geschrieben. Das entspricht sowohl dem NPF-Zeilenformat als auch dem, was
+// der X-Server auf x86 intern verwendet, sodass beim Laden nichts mehr
+// umgewandelt werden muss.
+
+#define PCF_PROPERTIES      (1 << 0)
+#define PCF_ACCELERATORS    (1 << 1)
+#define PCF_METRICS         (1 << 2)
+#define PCF_BITMAPS         (1 << 3)
+#define PCF_BDF_ENCODINGS   (1 << 5)
+#define PCF_BDF_ACCELERATORS (1 << 8)
+
+#define PCF_DEFAULT_FORMAT  0x00000000
+#define PCF_GLYPH_PAD_4     2
+
+#define PCF_TABLES 6
+
+struct pcf_buf
+{
+    uint8_t *data;
+    size_t len, cap;
+};
+
+struct pcf_metrics
+{
+    int16_t lsb, rsb, width, ascent, descent;
+};
 
-    if (filesz < sizeof(struct npf_char))
+static void pcf_put(struct pcf_buf *b, const void *src, size_t len)
+{
+    if (b->len + len > b->cap)
     {
-        fprintf(stderr, "Datei ist zu klein.\n");
-        return 1;
+        b->cap = (b->len + len) * 2;
+        b->data = realloc(b->data, b->cap);
     }
+    memcpy(b->data + b->len, src, len);
+    b->len += len;
+}
 
-    struct npf *npfh = malloc(filesz);
-    fread(npfh, filesz, 1, npf);
+static void pcf_put8(struct pcf_buf *b, uint8_t v)
+{
+    pcf_put(b, &v, 1);
+}
 
-    if (strncmp(npfh->sig, "NPF", 3))
+static void pcf_put16(struct pcf_buf *b, uint16_t v)
+{
+    uint8_t le[2] = { v, v >> 8 };
+    pcf_put(b, le, 2);
+}
+
+static void pcf_put32(struct pcf_buf *b, uint32_t v)
+{
+    uint8_t le[4] = { v, v >> 8, v >> 16, v >> 24 };
+    pcf_put(b, le, 4);
+}
+
+static void pcf_put_metrics(struct pcf_buf *b, const struct pcf_metrics *m)
+{
+    pcf_put16(b, m->lsb);
+    pcf_put16(b, m->rsb);
+    pcf_put16(b, m->width);
+    pcf_put16(b, m->ascent);
+    pcf_put16(b, m->descent);
+    pcf_put16(b, 0);
+}
+
+static void pcf_prop(struct pcf_buf *props, struct pcf_buf *strings, const char *name, const char *str, int32_t value)
+{
+    pcf_put32(props, strings->len);
+    pcf_put(strings, name, strlen(name) + 1);
+    pcf_put8(props, str != NULL);
+    if (str != NULL)
     {
-        fprintf(stderr, "Keine NPF-Datei.\n");
-        return 1;
+        pcf_put32(props, strings->len);
+        pcf_put(strings, str, strlen(str) + 1);
     }
+    else
+        pcf_put32(props, value);
+}
+
+static int npf_char_comparison(const void *x, const void *y)
+{
+    uint32_t a = (*(const struct npf_char **)x)->num, b = (*(const struct npf_char **)y)->num;
+    return (a > b) - (a < b);
+}
 
-    if (npfh->version != '2')
+static void write_pcf(FILE *pcf, const struct npf_char *char_array, unsigned chars, size_t charsz, unsigned fw, unsigned fh, const char *fname)
+{
+    // PCF kennt nur zweibytige Codes
+    const struct npf_char **sorted = malloc(chars * sizeof(*sorted));
+    unsigned glyphs = 0, skipped = 0;
+    const struct npf_char *c = char_array;
+    for (unsigned ci = 0; ci < chars; ci++)
     {
-        fprintf(stderr, "Nicht unterstützte Version.\n");
-        return 1;
+        if (c->num <= 0xFFFF)
+            sorted[glyphs++] = c;
+        else
+            skipped++;
+        c = (const struct npf_char *)((uintptr_t)c + charsz);
     }
 
-    if (npfh->width > 8)
+    if (skipped)
+        fprintf(stderr, "%u Zeichen außerhalb der BMP werden ausgelassen.\n", skipped);
+
+    qsort(sorted, glyphs, sizeof(*sorted), npf_char_comparison);
+
+    // Doppelte Codes entfernen
+    unsigned unique = 0;
+    for (unsigned i = 0; i < glyphs; i++)
+        if (!unique || (sorted[unique - 1]->num != sorted[i]->num))
+            sorted[unique++] = sorted[i];
+    glyphs = unique;
+
+    // Metriken aus den tatsächlich gesetzten Pixeln bestimmen; die
+    // Grundlinie liegt am unteren Rand der Zelle
+    struct pcf_metrics *m = calloc(glyphs, sizeof(*m));
+    struct pcf_metrics minb = { INT16_MAX, INT16_MAX, INT16_MAX, INT16_MAX, INT16_MAX };
+    struct pcf_metrics maxb = { INT16_MIN, INT16_MIN, INT16_MIN, INT16_MIN, INT16_MIN };
+    bool constant = true;
+    size_t bitmap_sizes[4] = { 0 };
+
+    for (unsigned i = 0; i < glyphs; i++)
     {
-        fprintf(stderr, "Schriftarten, die breiter als acht Pixel sind, werden nicht unterstützt.\n");
-        return 1;
+        struct npf_metrics nm = char_metrics(sorted[i], fw, fh);
+
+        if (!has_metrics)
+        {
+            uint8_t ink = 0;
+            int top = -1, bottom = -1;
+            for (unsigned y = 0; y < fh; y++)
+            {
+                if (sorted[i]->rows[y])
+                {
+                    if (top < 0)
+                        top = y;
+                    bottom = y;
+                    ink |= sorted[i]->rows[y];
+                }
+            }
+
+            nm.ink_w = nm.ink_h = 0;
+            if (ink)
+            {
+                nm.ink_x = __builtin_ctz(ink);
+                nm.ink_w = 32 - __builtin_clz(ink) - nm.ink_x;
+                nm.ink_y = top;
+                nm.ink_h = bottom + 1 - top;
+            }
+        }
+
+        m[i].width = nm.advance;
+        if (nm.ink_w && nm.ink_h)
+        {
+            m[i].lsb = nm.ink_x;
+            m[i].rsb = nm.ink_x + nm.ink_w;
+            m[i].ascent = fh - nm.ink_y;
+            m[i].descent = nm.ink_y + nm.ink_h - (int)fh;
+        }
+
+        if (i && memcmp(&m[i], &m[0], sizeof(m[0])))
+            constant = false;
+
+        int16_t *mi = (int16_t *)&m[i], *mn = (int16_t *)&minb, *mx = (int16_t *)&maxb;
+        for (unsigned f = 0; f < sizeof(m[0]) / sizeof(int16_t); f++)
+        {
+            if (mi[f] < mn[f])
+                mn[f] = mi[f];
+            if (mi[f] > mx[f])
+                mx[f] = mi[f];
+        }
+
+        unsigned rows = m[i].ascent + m[i].descent, bytes = (m[i].rsb - m[i].lsb + 7) / 8;
+        for (unsigned p = 0; p < 4; p++)
+            bitmap_sizes[p] += rows * ((bytes + (1 << p) - 1) & ~((1u << p) - 1));
     }
 
-    size_t charsz = npfh->height + sizeof(uint32_t);
+    if (!glyphs)
+        minb = maxb = (struct pcf_metrics){ 0, 0, fw, 0, 0 };
 
-    if ((filesz - sizeof(struct npf)) % charsz)
+    struct pcf_buf tables[PCF_TABLES] = { { 0 } };
+    uint32_t types[PCF_TABLES], formats[PCF_TABLES];
+
+
+    // Eigenschaften
+    unsigned avg_width;
+    char spacing[2] = { font_spacing(char_array, chars, charsz, fw, fh, &avg_width), 0 };
+
+    char xlfd[128];
+    snprintf(xlfd, sizeof(xlfd), "-NPF-%s-Medium-R-Normal--%i-80-75-75-%s-%u-ISO10646-1", fname, fh, spacing, avg_width);
+
+    uint32_t default_char = glyphs ? sorted[0]->num : 0;
+    for (unsigned i = 0; i < glyphs; i++)
+        if (sorted[i]->num == ' ')
+            default_char = ' ';
+
+    struct pcf_buf props = { 0 }, strings = { 0 };
+    pcf_prop(&props, &strings, "FONT", xlfd, 0);
+    pcf_prop(&props, &strings, "WEIGHT_NAME", "Medium", 0);
+    pcf_prop(&props, &strings, "SETWIDTH_NAME", "Normal", 0);
+    pcf_prop(&props, &strings, "SLANT", "R", 0);
+    pcf_prop(&props, &strings, "PIXEL_SIZE", NULL, fh);
+    pcf_prop(&props, &strings, "POINT_SIZE", NULL, 80);
+    pcf_prop(&props, &strings, "RESOLUTION_X", NULL, 100);
+    pcf_prop(&props, &strings, "RESOLUTION_Y", NULL, 100);
+    pcf_prop(&props, &strings, "SPACING", spacing, 0);
+    pcf_prop(&props, &strings, "AVERAGE_WIDTH", NULL, avg_width);
+    pcf_prop(&props, &strings, "CHARSET_REGISTRY", "ISO10646", 0);
+    pcf_prop(&props, &strings, "CHARSET_ENCODING", "1", 0);
+    pcf_prop(&props, &strings, "FAMILY_NAME", fname, 0);
+    pcf_prop(&props, &strings, "FONT_ASCENT", NULL, fh);
+    pcf_prop(&props, &strings, "FONT_DESCENT", NULL, 0);
+    pcf_prop(&props, &strings, "DEFAULT_CHAR", NULL, default_char);
+    unsigned nprops = props.len / 9;
+
+    types[0] = PCF_PROPERTIES;
+    formats[0] = PCF_DEFAULT_FORMAT;
+    pcf_put32(&tables[0], formats[0]);
+    pcf_put32(&tables[0], nprops);
+    pcf_put(&tables[0], props.data, props.len);
+    for (unsigned i = 0; i < ((4 - (nprops & 3)) & 3); i++)
+        pcf_put8(&tables[0], 0);
+    pcf_put32(&tables[0], strings.len);
+    pcf_put(&tables[0], strings.data, strings.len);
+    free(props.data);
+    free(strings.data);
+
+
+    // Beschleuniger (als PCF_ACCELERATORS und PCF_BDF_ACCELERATORS)
+    int max_overlap = maxb.rsb - minb.width;
+    bool ink_inside = (minb.lsb >= 0) && (maxb.rsb <= (int)fw) && (maxb.ascent <= (int)fh) && (maxb.descent <= 0);
+
+    struct pcf_buf accel = { 0 };
+    pcf_put8(&accel, max_overlap <= minb.lsb);
+    pcf_put8(&accel, constant);
+    pcf_put8(&accel, constant && (minb.lsb == 0) && (maxb.rsb == (int)fw) && (minb.ascent == (int)fh) && (maxb.descent == 0));
+    pcf_put8(&accel, minb.width == maxb.width);
+    pcf_put8(&accel, ink_inside);
+    pcf_put8(&accel, 0);
+    pcf_put8(&accel, 0);
+    pcf_put8(&accel, 0);
+    pcf_put32(&accel, fh);
+    pcf_put32(&accel, 0);
+    pcf_put32(&accel, max_overlap);
+    pcf_put_metrics(&accel, &minb);
+    pcf_put_metrics(&accel, &maxb);
+
+    types[1] = PCF_ACCELERATORS;
+    types[5] = PCF_BDF_ACCELERATORS;
+    formats[1] = formats[5] = PCF_DEFAULT_FORMAT;
+    pcf_put32(&tables[1], formats[1]);
+    pcf_put(&tables[1], accel.data, accel.len);
+    pcf_put32(&tables[5], formats[5]);
+    pcf_put(&tables[5], accel.data, accel.len);
+    free(accel.data);
+
+
+    // Metriken
+    types[2] = PCF_METRICS;
+    formats[2] = PCF_DEFAULT_FORMAT;
+    pcf_put32(&tables[2], formats[2]);
+    pcf_put32(&tables[2], glyphs);
+    for (unsigned i = 0; i < glyphs; i++)
+        pcf_put_metrics(&tables[2], &m[i]);
+
+
+    // Bitmaps
+    types[3] = PCF_BITMAPS;
+    formats[3] = PCF_DEFAULT_FORMAT | PCF_GLYPH_PAD_4;
+    pcf_put32(&tables[3], formats[3]);
+    pcf_put32(&tables[3], glyphs);
+
+    uint32_t offset = 0;
+    for (unsigned i = 0; i < glyphs; i++)
     {
-        fprintf(stderr, "Ungültige Dateigröße (kein Vielfaches der Zeichengröße).\n");
-        return 1;
+        pcf_put32(&tables[3], offset);
+        offset += (m[i].ascent + m[i].descent) * 4;
     }
+    for (unsigned p = 0; p < 4; p++)
+        pcf_put32(&tables[3], bitmap_sizes[p]);
 
-    unsigned chars = (filesz - sizeof(struct npf)) / charsz;
-    struct npf_char *char_array = malloc(chars * charsz);
-    memcpy(char_array, npfh + 1, chars * charsz);
+    for (unsigned i = 0; i < glyphs; i++)
+    {
+        int top = fh - m[i].ascent;
+        for (int y = top; y < top + m[i].ascent + m[i].descent; y++)
+        {
+            pcf_put8(&tables[3], sorted[i]->rows[y] >> m[i].lsb);
+            pcf_put8(&tables[3], 0);
+            pcf_put16(&tables[3], 0);
+        }
+    }
 
-    unsigned fw = npfh->width, fh = npfh->height;
 
-    char fname[25] = { 0 };
-    strncpy(fname, npfh->name, 24);
+    // Kodierung
+    unsigned min_b1 = 0xFF, max_b1 = 0, min_b2 = 0xFF, max_b2 = 0;
+    for (unsigned i = 0; i < glyphs; i++)
+    {
+        unsigned b1 = sorted[i]->num >> 8, b2 = sorted[i]->num & 0xFF;
+        min_b1 = (b1 < min_b1) ? b1 : min_b1;
+        max_b1 = (b1 > max_b1) ? b1 : max_b1;
+        min_b2 = (b2 < min_b2) ? b2 : min_b2;
+        max_b2 = (b2 > max_b2) ? b2 : max_b2;
+    }
+    if (!glyphs)
+        min_b1 = max_b1 = min_b2 = max_b2 = 0;
 
-    for (unsigned l = 23; (l > 0) && (fname[l] == ' '); l--)
-        fname[l] = 0;
+    unsigned cols = max_b2 - min_b2 + 1;
+    size_t enc_count = (size_t)(max_b1 - min_b1 + 1) * cols;
+    uint16_t *enc = malloc(enc_count * sizeof(*enc));
+    memset(enc, 0xFF, enc_count * sizeof(*enc));
+    for (unsigned i = 0; i < glyphs; i++)
+        enc[((sorted[i]->num >> 8) - min_b1) * cols + (sorted[i]->num & 0xFF) - min_b2] = i;
 
-    free(npfh);
+    types[4] = PCF_BDF_ENCODINGS;
+    formats[4] = PCF_DEFAULT_FORMAT;
+    pcf_put32(&tables[4], formats[4]);
+    pcf_put16(&tables[4], min_b2);
+    pcf_put16(&tables[4], max_b2);
+    pcf_put16(&tables[4], min_b1);
+    pcf_put16(&tables[4], max_b1);
+    pcf_put16(&tables[4], default_char);
+    for (size_t i = 0; i < enc_count; i++)
+        pcf_put16(&tables[4], enc[i]);
+    free(enc);
+
+
+    // Inhaltsverzeichnis und Tabellen (sind bereits aufsteigend nach Typ)
+    struct pcf_buf hdr = { 0 };
+    pcf_put(&hdr, "\1fcp", 4);
+    pcf_put32(&hdr, PCF_TABLES);
+
+    uint32_t pos = 8 + PCF_TABLES * 16;
+    for (int i = 0; i < PCF_TABLES; i++)
+    {
+        struct pcf_buf *t = &tables[i];
+        while (t->len & 3)
+            pcf_put8(t, 0);
+
+        pcf_put32(&hdr, types[i]);
+        pcf_put32(&hdr, formats[i]);
+        pcf_put32(&hdr, t->len);
+        pcf_put32(&hdr, pos);
+        pos += t->len;
+    }
+
+    fwrite(hdr.data, hdr.len, 1, pcf);
+    for (int i = 0; i < PCF_TABLES; i++)
+    {
+        fwrite(tables[i].data, tables[i].len, 1, pcf);
+        free(tables[i].data);
+    }
+
+    free(hdr.data);
+    free(m);
+    free(sorted);
+}
+
+static void write_bdf(FILE *bdf, const struct npf_char *char_array, unsigned chars, size_t charsz, unsigned fw, unsigned fh, const char *fname)
+{
+    unsigned avg_width;
+    char spacing = font_spacing(char_array, chars, charsz, fw, fh, &avg_width);
 
     fputs("STARTFONT 2.1\n", bdf);
-    fprintf(bdf, "FONT -NPF-%s-Medium-R-Normal--%i-80-75-75-C-60-ISO10646-1\n", fname, fh);
+    fprintf(bdf, "FONT -NPF-%s-Medium-R-Normal--%i-80-75-75-%c-%u-ISO10646-1\n", fname, fh, spacing, avg_width);
     fprintf(bdf, "SIZE %i 75 75\n", fh);
     fprintf(bdf, "FONTBOUNDINGBOX %i %i 0 0\n", fw, fh);
     fputs("STARTPROPERTIES 15\n", bdf);
@@ -103,8 +449,8 @@ int main(int argc, char *argv[])
     fputs("POINT_SIZE 80\n", bdf);
     fputs("RESOLUTION_X 100\n", bdf);
     fputs("RESOLUTION_Y 100\n", bdf);
-    fputs("SPACING \"C\"\n", bdf);
-    fputs("AVERAGE_WIDTH 60\n", bdf);
+    fprintf(bdf, "SPACING \"%c\"\n", spacing);
+    fprintf(bdf, "AVERAGE_WIDTH %u\n", avg_width);
     fputs("CHARSET_REGISTRY \"ISO10646\"\n", bdf);
     fputs("CHARSET_ENCODING \"1\"\n", bdf);
     fprintf(bdf, "FONT_NAME \"%s\"\n", fname);
@@ -114,19 +460,22 @@ int main(int argc, char *argv[])
     fputs("ENDPROPERTIES\n", bdf);
     fprintf(bdf, "CHARS %u\n", chars);
 
-    struct npf_char *c = char_array;
+    const struct npf_char *c = char_array;
     for (unsigned ci = 0; ci < chars; ci++)
     {
         fputs("STARTCHAR <anything>\n", bdf);
         fprintf(bdf, "ENCODING %i\n", c->num);
         fprintf(bdf, "SWIDTH %i 0\n", 72 / 75 * 1000);
-        fprintf(bdf, "DWIDTH %i 0\n", fw);
-        fprintf(bdf, "BBX %i %i 0 0\n", fw, fh);
+        struct npf_metrics m = char_metrics(c, fw, fh);
+        int yoff = m.ink_h ? (int)fh - m.ink_y - m.ink_h : 0;
+
+        fprintf(bdf, "DWIDTH %i 0\n", m.advance);
+        fprintf(bdf, "BBX %i %i %i %i\n", m.ink_w, m.ink_h, m.ink_x, yoff);
         fputs("BITMAP\n", bdf);
-        for (int y = 0; y < (int)fh; y++)
+        for (int y = m.ink_y; y < m.ink_y + m.ink_h; y++)
         {
             uint8_t num = 0;
-            for (int x = fw - 1; x >= 0; x--)
+            for (int x = m.ink_x + m.ink_w - 1; x >= m.ink_x; x--)
             {
                 num >>= 1;
                 if (c->rows[y] & (1 << x))
@@ -136,14 +485,109 @@ int main(int argc, char *argv[])
         }
         fputs("ENDCHAR\n", bdf);
 
-        c = (struct npf_char *)((uintptr_t)c + charsz);
+        c = (const struct npf_char *)((uintptr_t)c + charsz);
     }
 
     fputs("ENDFONT\n", bdf);
+}
+
+int main(int argc, char *argv[])
+{
+    bool pcf = false;
+
+    if ((argc >= 2) && !strcmp(argv[1], "-p"))
+    {
+        pcf = true;
+        argc--;
+        argv++;
+    }
+
+    if (argc < 3)
+    {
+        fprintf(stderr, "Benutzung: npf2bdf [-p] <npf> <bdf|pcf>\n");
+        fprintf(stderr, " -p: PCF statt BDF schreiben\n");
+        fprintf(stderr, "„-“ steht für die Standardein- bzw. -ausgabe.\n");
+        return 1;
+    }
+
+    struct npf_cache cache;
+    if (cache_lookup(&cache, "npf2bdf", pcf ? "-p" : "", argv[1], argv[2]))
+        return 0;
+
+    FILE *npf = stream_open(argv[1], "rb");
+    if (npf == NULL)
+        return 1;
+
+    FILE *out = stream_open(argv[2], "wb");
+    if (out == NULL)
+        return 1;
 
-    fclose(bdf);
+    size_t filesz;
+    struct npf *npfh = stream_read_all(npf, &filesz);
+    if (npfh == NULL)
+    {
+        fprintf(stderr, "%s: Lesefehler.\n", argv[1]);
+        return 1;
+    }
     fclose(npf);
+
+    if (filesz < sizeof(struct npf))
+    {
+        fprintf(stderr, "Datei ist zu klein.\n");
+        return 1;
+    }
+
+    if (strncmp(npfh->sig, "NPF", 3))
+    {
+        fprintf(stderr, "Keine NPF-Datei.\n");
+        return 1;
+    }
+
+    if ((npfh->version != '2') && (npfh->version != '3'))
+    {
+        fprintf(stderr, "Nicht unterstützte Version.\n");
+        return 1;
+    }
+
+    has_metrics = npfh->version >= '3';
+
+    if (npfh->width > 8)
+    {
+        fprintf(stderr, "Schriftarten, die breiter als acht Pixel sind, werden nicht unterstützt.\n");
+        return 1;
+    }
+
+    size_t charsz = npfh->height + sizeof(uint32_t) + (has_metrics ? sizeof(struct npf_metrics) : 0);
+
+    if ((filesz - sizeof(struct npf)) % charsz)
+    {
+        fprintf(stderr, "Ungültige Dateigröße (kein Vielfaches der Zeichengröße).\n");
+        return 1;
+    }
+
+    unsigned chars = (filesz - sizeof(struct npf)) / charsz;
+    struct npf_char *char_array = malloc(chars * charsz);
+    memcpy(char_array, npfh + 1, chars * charsz);
+
+    unsigned fw = npfh->width, fh = npfh->height;
+
+    char fname[25] = { 0 };
+    strncpy(fname, npfh->name, 24);
+
+    for (unsigned l = 23; (l > 0) && (fname[l] == ' '); l--)
+        fname[l] = 0;
+
+    free(npfh);
+
+    if (pcf)
+        write_pcf(out, char_array, chars, charsz, fw, fh, fname);
+    else
+        write_bdf(out, char_array, chars, charsz, fw, fh, fname);
+
+    fclose(out);
     free(char_array);
 
+    cache_store(&cache, argv[2]);
+
     return 0;
 }
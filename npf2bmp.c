@@ -1,8 +1,16 @@
+#define _DEFAULT_SOURCE
+
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "blit.h"
+#include "cache.h"
+#include "scale.h"
+#include "stream.h"
+
 struct npf
 {
     char sig[3], version;
@@ -16,6 +24,13 @@ struct npf_char
     uint8_t rows[];
 } __attribute__((packed));
 
+// Ab Version 3 folgen jedem Zeichen hinter den Zeilen seine Metriken
+struct npf_metrics
+{
+    uint8_t advance;
+    uint8_t ink_x, ink_y, ink_w, ink_h;
+} __attribute__((packed));
+
 struct npfc_list
 {
     struct npfc_list *next;
@@ -41,58 +56,80 @@ struct bmp_info
 
 int main(int argc, char *argv[])
 {
+    unsigned scale = 1;
+
+    if ((argc >= 3) && !strcmp(argv[1], "-s"))
+    {
+        char *tmp;
+        scale = strtoul(argv[2], &tmp, 0);
+        if (*tmp || (scale < 1) || (scale > SCALE_MAX))
+        {
+            fprintf(stderr, "Ungültiger Faktor (1 bis %i).\n", SCALE_MAX);
+            return 1;
+        }
+
+        argc -= 2;
+        argv += 2;
+    }
+
     if (argc < 3)
     {
-        fprintf(stderr, "Benutzung: npf2bmp <npf> <bmp>\n");
+        fprintf(stderr, "Benutzung: npf2bmp [-s <Faktor>] <npf> <bmp>\n");
+        fprintf(stderr, "„-“ steht für die Standardein- bzw. -ausgabe.\n");
         return 1;
     }
 
-    FILE *npf = fopen(argv[1], "rb");
+    char options[16];
+    snprintf(options, sizeof(options), "-s %u", scale);
+
+    struct npf_cache cache;
+    if (cache_lookup(&cache, "npf2bmp", options, argv[1], argv[2]))
+        return 0;
+
+    FILE *npf = stream_open(argv[1], "rb");
     if (npf == NULL)
-    {
-        perror(argv[1]);
         return 1;
-    }
 
-    FILE *bmp = fopen(argv[2], "wb");
+    FILE *bmp = stream_open(argv[2], "wb");
     if (bmp == NULL)
+        return 1;
+
+    size_t filesz;
+    struct npf *npfh = stream_read_all(npf, &filesz);
+    if (npfh == NULL)
     {
-        perror(argv[2]);
+        fprintf(stderr, "%s: Lesefehler.\n", argv[1]);
         return 1;
     }
+    fclose(npf);
 
-    fseek(npf, 0, SEEK_END);
-    size_t filesz = ftell(npf);
-    rewind(npf);
-
-    if (filesz < sizeof(struct npf_char))
+    if (filesz < sizeof(struct npf))
     {
         fprintf(stderr, "Datei ist zu klein.\n");
         return 1;
     }
 
-    struct npf *npfh = malloc(filesz);
-    fread(npfh, filesz, 1, npf);
-
     if (strncmp(npfh->sig, "NPF", 3))
     {
         fprintf(stderr, "Keine NPF-Datei.\n");
         return 1;
     }
 
-    if (npfh->version != '2')
+    if ((npfh->version != '2') && (npfh->version != '3'))
     {
         fprintf(stderr, "Nicht unterstützte Version.\n");
         return 1;
     }
 
+    bool has_metrics = npfh->version >= '3';
+
     if (npfh->width > 8)
     {
         fprintf(stderr, "Schriftarten, die breiter als acht Pixel sind, werden nicht unterstützt.\n");
         return 1;
     }
 
-    size_t charsz = npfh->height + sizeof(uint32_t);
+    size_t charsz = npfh->height + sizeof(uint32_t) + (has_metrics ? sizeof(struct npf_metrics) : 0);
 
     if ((filesz - sizeof(struct npf)) % charsz)
     {
@@ -104,7 +141,7 @@ int main(int argc, char *argv[])
     struct npf_char *char_array = malloc(chars * charsz);
     memcpy(char_array, npfh + 1, chars * charsz);
 
-    unsigned fw = npfh->width, fh = npfh->height;
+    unsigned fw = npfh->width * scale, fh = npfh->height * scale;
 
     char fname[25] = { 0 };
     strncpy(fname, npfh->name, 24);
@@ -176,6 +213,14 @@ int main(int argc, char *argv[])
     size_t bufsz = line_length * (fh + 1);
     uint8_t *buf = malloc(bufsz);
 
+    scale_init();
+
+    // Zeichen werden zuerst skaliert und dann mit dem Kernel für die
+    // skalierte Zellgröße gezeichnet
+    struct blit blitter = blit_select(fw, fh, 3);
+    size_t srowsz = (fw + 7) / 8;
+    uint8_t *scaled = malloc(fh * srowsz + SCALE_MAX);
+
     cle = cl;
     while (cle != NULL)
     {
@@ -186,16 +231,38 @@ int main(int argc, char *argv[])
         while ((cle != NULL) && ((cle->chr->num >> 4) == cline))
         {
             uint8_t *pos = buf + (cle->chr->num & 0xF) * (fw + 1) * 3;
+            const uint8_t *rows = cle->chr->rows;
 
-            for (unsigned ry = 0; ry < fh; ry++)
+            if (scale > 1)
             {
-                uint8_t row = cle->chr->rows[ry];
-                for (unsigned rx = 0; rx < fw; rx++)
-                    if (row & (1 << rx))
-                        pos[rx * 3] = pos[rx * 3 + 1] = pos[rx * 3 + 2] = 0;
-                pos += line_length;
+                for (unsigned ry = 0; ry < fh / scale; ry++)
+                {
+                    uint8_t *srow = &scaled[ry * scale * srowsz];
+                    scale_row(srow, &cle->chr->rows[ry], 1, scale);
+                    for (unsigned i = 1; i < scale; i++)
+                        memcpy(srow + i * srowsz, srow, srowsz);
+                }
+                rows = scaled;
             }
 
+            // Mit Metriken nur den gesetzten Bereich zeichnen, der Puffer ist
+            // schon weiß; Metriken, die über die Zelle hinausreichen
+            // (beschädigte Datei), gelten nicht
+            unsigned x0 = 0, y0 = 0, w = fw, h = fh;
+            if (has_metrics)
+            {
+                const struct npf_metrics *m = (const struct npf_metrics *)&cle->chr->rows[fh / scale];
+                if ((m->ink_x + m->ink_w <= fw / scale) && (m->ink_y + m->ink_h <= fh / scale))
+                {
+                    x0 = m->ink_x * scale;
+                    y0 = m->ink_y * scale;
+                    w = m->ink_w * scale;
+                    h = m->ink_h * scale;
+                }
+            }
+
+            blit_region(&blitter, pos, line_length, rows, x0, y0, w, h, 0x00, 0xFF);
+
             cle = cle->next;
         }
 
@@ -206,7 +273,10 @@ int main(int argc, char *argv[])
     }
 
     fclose(bmp);
+    free(scaled);
     free(buf);
 
+    cache_store(&cache, argv[2]);
+
     return 0;
 }
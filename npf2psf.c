@@ -0,0 +1,207 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stream.h"
+
+struct npf
+{
+    char sig[3], version;
+    uint16_t height, width;
+    char name[24];
+} __attribute__((packed));
+
+struct npf_char
+{
+    uint32_t num;
+    uint8_t rows[];
+} __attribute__((packed));
+
+// Ab Version 3 folgen jedem Zeichen hinter den Zeilen seine Metriken
+struct npf_metrics
+{
+    uint8_t advance;
+    uint8_t ink_x, ink_y, ink_w, ink_h;
+} __attribute__((packed));
+
+struct psf2
+{
+    uint8_t magic[4];
+    uint32_t version, headersize, flags;
+    uint32_t length, charsize;
+    uint32_t height, width;
+} __attribute__((packed));
+
+#define PSF2_HAS_UNICODE_TABLE 0x01
+
+#define PSF2_SEPARATOR 0xFF
+
+// Mehr Zeichen kann die Linux-Konsole nicht laden
+#define CONSOLE_MAX_CHARS 512
+
+static int npf_char_comparison(const void *x, const void *y)
+{
+    uint32_t a = (*(const struct npf_char **)x)->num, b = (*(const struct npf_char **)y)->num;
+    return (a > b) - (a < b);
+}
+
+static size_t write_utf8(uint8_t *dst, uint32_t cp)
+{
+    if (cp < 0x80)
+    {
+        dst[0] = cp;
+        return 1;
+    }
+    else if (cp < 0x800)
+    {
+        dst[0] = 0xC0 | (cp >> 6);
+        dst[1] = 0x80 | (cp & 0x3F);
+        return 2;
+    }
+    else if (cp < 0x10000)
+    {
+        dst[0] = 0xE0 | (cp >> 12);
+        dst[1] = 0x80 | ((cp >> 6) & 0x3F);
+        dst[2] = 0x80 | (cp & 0x3F);
+        return 3;
+    }
+
+    dst[0] = 0xF0 | (cp >> 18);
+    dst[1] = 0x80 | ((cp >> 12) & 0x3F);
+    dst[2] = 0x80 | ((cp >> 6) & 0x3F);
+    dst[3] = 0x80 | (cp & 0x3F);
+    return 4;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Benutzung: npf2psf <npf> <psf>\n");
+        fprintf(stderr, "„-“ steht für die Standardein- bzw. -ausgabe.\n");
+        return 1;
+    }
+
+    FILE *npf = stream_open(argv[1], "rb");
+    if (npf == NULL)
+        return 1;
+
+    size_t filesz;
+    struct npf *npfh = stream_read_all(npf, &filesz);
+    if (npfh == NULL)
+    {
+        fprintf(stderr, "%s: Lesefehler.\n", argv[1]);
+        return 1;
+    }
+    fclose(npf);
+
+    if (filesz < sizeof(struct npf))
+    {
+        fprintf(stderr, "Datei ist zu klein.\n");
+        return 1;
+    }
+
+    if (strncmp(npfh->sig, "NPF", 3))
+    {
+        fprintf(stderr, "Keine NPF-Datei.\n");
+        return 1;
+    }
+
+    if ((npfh->version != '2') && (npfh->version != '3'))
+    {
+        fprintf(stderr, "Nicht unterstützte Version.\n");
+        return 1;
+    }
+
+    size_t glyphsz = npfh->height * ((npfh->width + 7) / 8);
+    size_t charsz = glyphsz + sizeof(uint32_t) + ((npfh->version >= '3') ? sizeof(struct npf_metrics) : 0);
+
+    if ((filesz - sizeof(struct npf)) % charsz)
+    {
+        fprintf(stderr, "Ungültige Dateigröße (kein Vielfaches der Zeichengröße).\n");
+        return 1;
+    }
+
+    unsigned chars = (filesz - sizeof(struct npf)) / charsz;
+
+    const struct npf_char **sorted = malloc(chars * sizeof(*sorted));
+    const struct npf_char *c = (const struct npf_char *)(npfh + 1);
+    for (unsigned ci = 0; ci < chars; ci++)
+    {
+        sorted[ci] = c;
+        c = (const struct npf_char *)((uintptr_t)c + charsz);
+    }
+
+    qsort(sorted, chars, sizeof(*sorted), npf_char_comparison);
+
+    unsigned glyphs = 0, invalid = 0;
+    for (unsigned ci = 0; ci < chars; ci++)
+    {
+        if (sorted[ci]->num > 0x10FFFF)
+            invalid++;
+        else if (!glyphs || (sorted[glyphs - 1]->num != sorted[ci]->num))
+            sorted[glyphs++] = sorted[ci];
+    }
+
+    if (invalid)
+        fprintf(stderr, "%u Zeichen mit ungültigem Code werden ausgelassen.\n", invalid);
+
+    if (glyphs > CONSOLE_MAX_CHARS)
+        fprintf(stderr, "Warnung: %u Zeichen, die Linux-Konsole lädt höchstens %u.\n", glyphs, CONSOLE_MAX_CHARS);
+
+    FILE *psf = stream_open(argv[2], "wb");
+    if (psf == NULL)
+        return 1;
+
+    struct psf2 psfh = {
+        .magic = { 0x72, 0xB5, 0x4A, 0x86 },
+        .version = 0,
+        .headersize = sizeof(psfh),
+        .flags = PSF2_HAS_UNICODE_TABLE,
+        .length = glyphs,
+        .charsize = glyphsz,
+        .height = npfh->height,
+        .width = npfh->width
+    };
+
+    fwrite(&psfh, sizeof(psfh), 1, psf);
+
+    // PSF2 speichert das höchstwertige Bit links, NPF das niederwertigste
+    uint8_t bitrev[256];
+    for (unsigned i = 0; i < 256; i++)
+    {
+        bitrev[i] = 0;
+        for (unsigned j = 0; j < 8; j++)
+            if (i & (1 << j))
+                bitrev[i] |= 0x80 >> j;
+    }
+
+    uint8_t *buf = malloc(glyphs * glyphsz);
+    for (unsigned g = 0; g < glyphs; g++)
+        for (size_t i = 0; i < glyphsz; i++)
+            buf[g * glyphsz + i] = bitrev[sorted[g]->rows[i]];
+
+    fwrite(buf, glyphsz, glyphs, psf);
+    free(buf);
+
+    // Unicodetabelle: je Zeichen ein UTF-8-Code und ein Trenner
+    uint8_t *table = malloc(glyphs * 5);
+    size_t tablesz = 0;
+    for (unsigned g = 0; g < glyphs; g++)
+    {
+        tablesz += write_utf8(&table[tablesz], sorted[g]->num);
+        table[tablesz++] = PSF2_SEPARATOR;
+    }
+
+    fwrite(table, tablesz, 1, psf);
+    free(table);
+
+    fprintf(stream_messages(psf), "%u Zeichen geschrieben.\n", glyphs);
+
+    fclose(psf);
+    free(sorted);
+    free(npfh);
+
+    return 0;
+}
@@ -0,0 +1,425 @@
+#define _DEFAULT_SOURCE
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct npf
+{
+    char sig[3], version;
+    uint16_t height, width;
+    char name[24];
+} __attribute__((packed));
+
+struct npf_char
+{
+    uint32_t num;
+    uint8_t rows[];
+} __attribute__((packed));
+
+// Ab Version 3 folgen jedem Zeichen hinter den Zeilen seine Metriken
+struct npf_metrics
+{
+    uint8_t advance;
+    uint8_t ink_x, ink_y, ink_w, ink_h;
+} __attribute__((packed));
+
+struct bmp_header
+{
+    char type[2];
+    uint32_t sz, rsvd;
+    uint32_t offset;
+} __attribute__((packed));
+
+struct bmp_info
+{
+    uint32_t size;
+    int32_t width, height;
+    uint16_t planes, bpp;
+    uint32_t compression, sz;
+    int32_t xdpm, ydpm;
+    uint32_t clr_used, clr_important;
+} __attribute__((packed));
+
+struct glyph
+{
+    const struct npf_char *chr;
+    unsigned line;
+};
+
+#define SDF_INF 1e20f
+
+// Unveränderliche Eingaben für alle Arbeitsthreads
+static unsigned fw, fh, scale, spread;
+static unsigned cell_w, cell_h;
+static size_t rowsz, line_length;
+static struct glyph *glyphs;
+static unsigned glyph_count;
+static uint8_t *img;
+
+static atomic_uint next_glyph;
+
+static int glyph_comparison(const void *x, const void *y)
+{
+    const struct npf_char *cx = ((const struct glyph *)x)->chr, *cy = ((const struct glyph *)y)->chr;
+    if (cx->num != cy->num)
+        return (cx->num < cy->num) ? -1 : 1;
+    // Bei gleichen Codes entscheidet die Position in der Datei, damit das
+    // erste Vorkommen vorne steht (qsort() ist nicht stabil)
+    return (cx < cy) ? -1 : (cx > cy);
+}
+
+static bool pixel(const struct npf_char *c, unsigned x, unsigned y)
+{
+    return c->rows[y * rowsz + x / 8] & (1 << (x % 8));
+}
+
+// Exakte eindimensionale Distanztransformation (Felzenszwalb/Huttenlocher):
+// d[q] = min_p ((q - p)² + f[p]), über die untere Hülle der Parabeln
+static void edt_1d(const float *f, float *d, unsigned *v, float *z, unsigned n)
+{
+    unsigned k = 0;
+    v[0] = 0;
+    z[0] = -SDF_INF;
+    z[1] = SDF_INF;
+
+    for (unsigned q = 1; q < n; q++)
+    {
+        // z[0] ist -∞, k kann also nicht unter 0 fallen
+        float s;
+        for (;;)
+        {
+            unsigned p = v[k];
+            s = ((f[q] + (float)q * q) - (f[p] + (float)p * p)) / (2.f * q - 2.f * p);
+            if (s > z[k])
+                break;
+            k--;
+        }
+
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = SDF_INF;
+    }
+
+    k = 0;
+    for (unsigned q = 0; q < n; q++)
+    {
+        while (z[k + 1] < q)
+            k++;
+        float dq = (float)q - v[k];
+        d[q] = dq * dq + f[v[k]];
+    }
+}
+
+// Quadrierte Distanz jedes Pixels zum nächsten Pixel, für das grid 0 ist;
+// erst über die Spalten, dann über die Zeilen
+static void edt_2d(float *grid, unsigned w, unsigned h, float *f, float *d, unsigned *v, float *z)
+{
+    for (unsigned x = 0; x < w; x++)
+    {
+        for (unsigned y = 0; y < h; y++)
+            f[y] = grid[y * w + x];
+        edt_1d(f, d, v, z, h);
+        for (unsigned y = 0; y < h; y++)
+            grid[y * w + x] = d[y];
+    }
+
+    for (unsigned y = 0; y < h; y++)
+    {
+        memcpy(f, &grid[y * w], w * sizeof(*f));
+        edt_1d(f, &grid[y * w], v, z, w);
+    }
+}
+
+static void *sdf_worker(void *arg)
+{
+    (void)arg;
+
+    unsigned n = (cell_w > cell_h) ? cell_w : cell_h;
+    float *to_ink = malloc(cell_w * cell_h * sizeof(*to_ink));
+    float *to_bg = malloc(cell_w * cell_h * sizeof(*to_bg));
+    float *f = malloc(n * sizeof(*f));
+    float *d = malloc(n * sizeof(*d));
+    float *z = malloc((n + 1) * sizeof(*z));
+    unsigned *v = malloc(n * sizeof(*v));
+
+    unsigned i;
+    while ((i = atomic_fetch_add_explicit(&next_glyph, 1, memory_order_relaxed)) < glyph_count)
+    {
+        const struct npf_char *c = glyphs[i].chr;
+
+        // Hochskaliertes Zeichen mit spread Pixeln Rand
+        for (unsigned y = 0; y < cell_h; y++)
+        {
+            for (unsigned x = 0; x < cell_w; x++)
+            {
+                bool ink = (x >= spread) && (x < spread + fw * scale) &&
+                           (y >= spread) && (y < spread + fh * scale) &&
+                           pixel(c, (x - spread) / scale, (y - spread) / scale);
+                to_ink[y * cell_w + x] = ink ? 0.f : SDF_INF;
+                to_bg[y * cell_w + x] = ink ? SDF_INF : 0.f;
+            }
+        }
+
+        edt_2d(to_ink, cell_w, cell_h, f, d, v, z);
+        edt_2d(to_bg, cell_w, cell_h, f, d, v, z);
+
+        // Die Kante liegt zwischen den Pixelmitten, also einen halben Pixel
+        // von beiden Seiten entfernt; 128 entspricht genau der Kante
+        uint8_t *dst = img + (size_t)glyphs[i].line * cell_h * line_length + (c->num & 0xF) * cell_w;
+        for (unsigned y = 0; y < cell_h; y++)
+        {
+            for (unsigned x = 0; x < cell_w; x++)
+            {
+                float dist = (to_bg[y * cell_w + x] > 0.f) ? sqrtf(to_bg[y * cell_w + x]) - .5f
+                                                            : .5f - sqrtf(to_ink[y * cell_w + x]);
+                float val = 128.f + dist * 127.f / spread;
+                dst[x] = (val < 0.f) ? 0 : (val > 255.f) ? 255 : (uint8_t)lrintf(val);
+            }
+            dst += line_length;
+        }
+    }
+
+    free(to_ink);
+    free(to_bg);
+    free(f);
+    free(d);
+    free(z);
+    free(v);
+
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned threads = 0;
+    scale = 4;
+    spread = 0;
+
+    while ((argc > 2) && (argv[1][0] == '-'))
+    {
+        char *tmp;
+        unsigned val = strtoul(argv[2], &tmp, 0);
+        if (*tmp || !val)
+        {
+            fprintf(stderr, "Ungültiger Wert für %s.\n", argv[1]);
+            return 1;
+        }
+
+        if (!strcmp(argv[1], "-s") && (val <= 64))
+            scale = val;
+        else if (!strcmp(argv[1], "-r") && (val <= 255))
+            spread = val;
+        else if (!strcmp(argv[1], "-j") && (val <= 1024))
+            threads = val;
+        else
+        {
+            fprintf(stderr, "Unbekannte Option oder ungültiger Wert: %s %s\n", argv[1], argv[2]);
+            return 1;
+        }
+
+        argc -= 2;
+        argv += 2;
+    }
+
+    if (argc < 4)
+    {
+        fprintf(stderr, "Benutzung: npf2sdf [-s <Faktor>] [-r <Radius>] [-j <Threads>] <npf> <bmp> <Metriken>\n");
+        fprintf(stderr, " -s: Vergrößerungsfaktor (Standard: 4)\n");
+        fprintf(stderr, " -r: Reichweite des Distanzfelds in Pixeln (Standard: zweifacher Faktor)\n");
+        fprintf(stderr, " -j: Anzahl der Threads (Standard: Anzahl der Prozessoren)\n");
+        fprintf(stderr, "Die Metriken werden als JSON geschrieben.\n");
+        return 1;
+    }
+
+    if (!spread)
+        spread = 2 * scale;
+
+    if (!threads)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (cpus > 0) ? cpus : 1;
+    }
+
+    FILE *npf = fopen(argv[1], "rb");
+    if (npf == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    fseek(npf, 0, SEEK_END);
+    size_t filesz = ftell(npf);
+    rewind(npf);
+
+    if (filesz < sizeof(struct npf))
+    {
+        fprintf(stderr, "Datei ist zu klein.\n");
+        return 1;
+    }
+
+    struct npf *npfh = malloc(filesz);
+    fread(npfh, filesz, 1, npf);
+    fclose(npf);
+
+    if (strncmp(npfh->sig, "NPF", 3))
+    {
+        fprintf(stderr, "Keine NPF-Datei.\n");
+        return 1;
+    }
+
+    if ((npfh->version != '2') && (npfh->version != '3'))
+    {
+        fprintf(stderr, "Nicht unterstützte Version.\n");
+        return 1;
+    }
+
+    bool has_metrics = npfh->version >= '3';
+    fw = npfh->width;
+    fh = npfh->height;
+    rowsz = (fw + 7) / 8;
+    size_t charsz = fh * rowsz + sizeof(uint32_t) + (has_metrics ? sizeof(struct npf_metrics) : 0);
+
+    if ((filesz - sizeof(struct npf)) % charsz)
+    {
+        fprintf(stderr, "Ungültige Dateigröße (kein Vielfaches der Zeichengröße).\n");
+        return 1;
+    }
+
+    unsigned chars = (filesz - sizeof(struct npf)) / charsz;
+    glyphs = malloc((chars ? chars : 1) * sizeof(*glyphs));
+
+    const struct npf_char *c = (const struct npf_char *)(npfh + 1);
+    for (unsigned ci = 0; ci < chars; ci++)
+    {
+        glyphs[ci].chr = c;
+        c = (const struct npf_char *)((uintptr_t)c + charsz);
+    }
+
+    // Gleiche Anordnung wie bei npf2bmp: 16 Zeichen je Zeile, leere Zeilen
+    // entfallen. Doppelte Codes werden verworfen (das erste Vorkommen zählt).
+    qsort(glyphs, chars, sizeof(*glyphs), glyph_comparison);
+
+    unsigned lines = 0;
+    glyph_count = 0;
+    for (unsigned i = 0; i < chars; i++)
+    {
+        if (glyph_count && (glyphs[glyph_count - 1].chr->num == glyphs[i].chr->num))
+            continue;
+        if (!glyph_count || ((glyphs[glyph_count - 1].chr->num >> 4) != (glyphs[i].chr->num >> 4)))
+            lines++;
+
+        glyphs[glyph_count] = glyphs[i];
+        glyphs[glyph_count++].line = lines - 1;
+    }
+
+    cell_w = fw * scale + 2 * spread;
+    cell_h = fh * scale + 2 * spread;
+
+    uint64_t atlas_w = 16 * (uint64_t)cell_w, atlas_h = (uint64_t)(lines ? lines : 1) * cell_h;
+    line_length = (atlas_w + 3) & ~(uint64_t)3;
+
+    if ((atlas_w > INT32_MAX) || (atlas_h > INT32_MAX) || (line_length * atlas_h > UINT32_MAX))
+    {
+        fprintf(stderr, "Atlas wäre zu groß.\n");
+        return 1;
+    }
+
+    img = calloc(line_length, atlas_h);
+
+    if (threads > glyph_count)
+        threads = glyph_count ? glyph_count : 1;
+
+    pthread_t *tids = malloc(threads * sizeof(*tids));
+    atomic_init(&next_glyph, 0);
+
+    for (unsigned i = 1; i < threads; i++)
+    {
+        if (pthread_create(&tids[i], NULL, sdf_worker, NULL))
+        {
+            fprintf(stderr, "Konnte keinen Thread erstellen.\n");
+            return 1;
+        }
+    }
+
+    sdf_worker(NULL);
+
+    for (unsigned i = 1; i < threads; i++)
+        pthread_join(tids[i], NULL);
+
+    free(tids);
+
+    FILE *bmp = fopen(argv[2], "wb");
+    if (bmp == NULL)
+    {
+        perror(argv[2]);
+        return 1;
+    }
+
+    struct bmp_header bmph = {
+        .type = "BM",
+        .sz = sizeof(struct bmp_header) + sizeof(struct bmp_info) + 256 * 4 + line_length * atlas_h,
+        .offset = sizeof(struct bmp_header) + sizeof(struct bmp_info) + 256 * 4
+    };
+
+    struct bmp_info bmpi = {
+        .size = sizeof(bmpi),
+        .width = atlas_w,
+        .height = -(int32_t)atlas_h,
+        .planes = 1,
+        .bpp = 8,
+        .compression = 0,
+        .sz = line_length * atlas_h,
+        .clr_used = 256
+    };
+
+    uint8_t palette[256 * 4];
+    for (unsigned i = 0; i < 256; i++)
+    {
+        palette[i * 4] = palette[i * 4 + 1] = palette[i * 4 + 2] = i;
+        palette[i * 4 + 3] = 0;
+    }
+
+    fwrite(&bmph, sizeof(bmph), 1, bmp);
+    fwrite(&bmpi, sizeof(bmpi), 1, bmp);
+    fwrite(palette, sizeof(palette), 1, bmp);
+    fwrite(img, line_length, atlas_h, bmp);
+    fclose(bmp);
+
+    FILE *met = fopen(argv[3], "wb");
+    if (met == NULL)
+    {
+        perror(argv[3]);
+        return 1;
+    }
+
+    // Alle Angaben in Atlaspixeln; xoff/yoff ist die Lage des Rechtecks
+    // relativ zum Ursprung der (vergrößerten) Zeichenzelle
+    fprintf(met, "{\"width\":%u,\"height\":%u,\"scale\":%u,\"spread\":%u,\"cell_width\":%u,\"cell_height\":%u,\"glyphs\":[",
+            (unsigned)atlas_w, (unsigned)atlas_h, scale, spread, fw * scale, fh * scale);
+    for (unsigned i = 0; i < glyph_count; i++)
+    {
+        const struct npf_char *gc = glyphs[i].chr;
+        unsigned advance = has_metrics ? ((const struct npf_metrics *)&gc->rows[fh * rowsz])->advance : fw;
+        fprintf(met, "%s\n{\"cp\":%u,\"x\":%u,\"y\":%u,\"w\":%u,\"h\":%u,\"xoff\":%i,\"yoff\":%i,\"advance\":%u}",
+                i ? "," : "", (unsigned)gc->num, (unsigned)(gc->num & 0xF) * cell_w, glyphs[i].line * cell_h,
+                cell_w, cell_h, -(int)spread, -(int)spread, advance * scale);
+    }
+    fputs("\n]}\n", met);
+    fclose(met);
+
+    printf("%u Distanzfelder (%u×%u) mit %u Thread(s) erzeugt.\n", glyph_count, cell_w, cell_h, threads);
+
+    free(img);
+    free(glyphs);
+    free(npfh);
+
+    return 0;
+}
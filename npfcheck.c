@@ -0,0 +1,330 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct npf
+{
+    char sig[3], version;
+    uint16_t height, width;
+    char name[24];
+} __attribute__((packed));
+
+struct npf_char
+{
+    uint32_t num;
+    uint8_t rows[];
+} __attribute__((packed));
+
+// Ab Version 3 folgen jedem Zeichen hinter den Zeilen seine Metriken
+struct npf_metrics
+{
+    uint8_t advance;
+    uint8_t ink_x, ink_y, ink_w, ink_h;
+} __attribute__((packed));
+
+#define UNICODE_MAX 0x10FFFF
+
+// Von jeder Art Fehler werden nur so viele einzeln gemeldet
+#define REPORT_MAX 10
+
+enum problem
+{
+    PROBLEM_RANGE,
+    PROBLEM_DUPLICATE,
+    PROBLEM_ORDER,
+    PROBLEM_BITS,
+    PROBLEM_METRICS,
+
+    PROBLEMS
+};
+
+static const char *const problem_desc[PROBLEMS] = {
+    "Code außerhalb von Unicode",
+    "Code mehrfach vorhanden",
+    "Zeichen nicht nach Code sortiert",
+    "Pixel außerhalb der Zeichenbreite",
+    "Metriken passen nicht zum gesetzten Bereich"
+};
+
+// Ein Bit je möglichem Code
+static uint64_t seen[(UNICODE_MAX + 1) / 64];
+
+static unsigned fw, fh, rowsz;
+static size_t rowbytes;
+static unsigned long problems[PROBLEMS];
+
+static void report(enum problem p, uint32_t num)
+{
+    if (problems[p]++ < REPORT_MAX)
+        printf("U+%04X: %s.\n", (unsigned)num, problem_desc[p]);
+    else if (problems[p] == REPORT_MAX + 1)
+        printf("(Weitere Fehler der Art „%s“ werden nicht mehr einzeln gemeldet.)\n", problem_desc[p]);
+}
+
+static uint64_t load64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// bad enthält für jedes Byte der Zeilen die Bits jenseits der Zeichenbreite;
+// geprüft wird in 64-Bit-Wörtern, nur der Rest byteweise
+static bool stray_bits(const uint8_t *rows, const uint8_t *bad)
+{
+    uint64_t any = 0;
+    size_t i;
+
+    for (i = 0; i + 8 <= rowbytes; i += 8)
+        any |= load64(rows + i) & load64(bad + i);
+    for (; i < rowbytes; i++)
+        any |= rows[i] & bad[i];
+
+    return any;
+}
+
+static void ink_bounds(struct npf_metrics *m, const uint8_t *rows)
+{
+    uint8_t cols[rowsz];
+    int top = -1, bottom = -1;
+
+    memset(cols, 0, rowsz);
+    for (unsigned y = 0; y < fh; y++)
+    {
+        uint8_t any = 0;
+        for (unsigned x = 0; x < rowsz; x++)
+        {
+            cols[x] |= rows[y * rowsz + x];
+            any |= rows[y * rowsz + x];
+        }
+
+        if (any)
+        {
+            if (top < 0)
+                top = y;
+            bottom = y;
+        }
+    }
+
+    m->ink_x = m->ink_y = m->ink_w = m->ink_h = 0;
+    if (top < 0)
+        return;
+
+    unsigned first = 0, last = rowsz - 1;
+    while (!cols[first])
+        first++;
+    while (!cols[last])
+        last--;
+
+    m->ink_x = first * 8 + __builtin_ctz(cols[first]);
+    m->ink_w = last * 8 + 32 - __builtin_clz(cols[last]) - m->ink_x;
+    m->ink_y = top;
+    m->ink_h = bottom - top + 1;
+}
+
+static int char_comparison(const void *x, const void *y)
+{
+    uint32_t a = (*(const struct npf_char *const *)x)->num, b = (*(const struct npf_char *const *)y)->num;
+    return (a > b) - (a < b);
+}
+
+int main(int argc, char *argv[])
+{
+    bool fix = false;
+
+    if ((argc >= 2) && !strcmp(argv[1], "-f"))
+    {
+        fix = true;
+        argc--;
+        argv++;
+    }
+
+    if ((argc < 2) || (!fix && (argc > 2)))
+    {
+        fprintf(stderr, "Benutzung: npfcheck [-f] <npf> [<Ausgabe>]\n");
+        fprintf(stderr, " -f: Fehler beheben und das Ergebnis schreiben (ohne Ausgabe in die Eingabedatei)\n");
+        return 1;
+    }
+
+    const char *out_name = (argc > 2) ? argv[2] : argv[1];
+
+    FILE *fp = fopen(argv[1], "rb");
+    if (fp == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    size_t filesz = ftell(fp);
+    rewind(fp);
+
+    if (filesz < sizeof(struct npf))
+    {
+        fprintf(stderr, "Datei ist zu klein.\n");
+        return 1;
+    }
+
+    struct npf *npfh = malloc(filesz);
+    if (fread(npfh, 1, filesz, fp) != filesz)
+    {
+        fprintf(stderr, "%s: Lesefehler.\n", argv[1]);
+        return 1;
+    }
+    fclose(fp);
+
+    if (strncmp(npfh->sig, "NPF", 3))
+    {
+        fprintf(stderr, "Keine NPF-Datei.\n");
+        return 1;
+    }
+
+    if ((npfh->version != '2') && (npfh->version != '3'))
+    {
+        fprintf(stderr, "Nicht unterstützte Version.\n");
+        return 1;
+    }
+
+    if (!npfh->width || !npfh->height)
+    {
+        fprintf(stderr, "Ungültige Zeichengröße %u×%u.\n", npfh->width, npfh->height);
+        return 1;
+    }
+
+    bool has_metrics = npfh->version >= '3';
+    fw = npfh->width;
+    fh = npfh->height;
+    rowsz = (fw + 7) / 8;
+    rowbytes = (size_t)fh * rowsz;
+    size_t charsz = rowbytes + sizeof(uint32_t) + (has_metrics ? sizeof(struct npf_metrics) : 0);
+
+    if ((filesz - sizeof(struct npf)) % charsz)
+    {
+        fprintf(stderr, "Ungültige Dateigröße (kein Vielfaches der Zeichengröße).\n");
+        return 1;
+    }
+
+    size_t chars = (filesz - sizeof(struct npf)) / charsz;
+
+    // Maske der Bits, die nie gesetzt sein dürfen; ist die Breite ein
+    // Vielfaches von acht, gibt es keine
+    uint8_t *bad = calloc(rowbytes, 1);
+    if (fw % 8)
+        for (unsigned y = 0; y < fh; y++)
+            bad[y * rowsz + rowsz - 1] = ~((1u << (fw % 8)) - 1);
+
+    // Zeichen, die in der Ausgabe bleiben (in der Reihenfolge der Datei)
+    struct npf_char **keep = fix ? malloc(chars * sizeof(*keep)) : NULL;
+    size_t kept = 0;
+
+    uint32_t last = 0;
+    bool sorted = true;
+
+    struct npf_char *c = (struct npf_char *)(npfh + 1);
+    for (size_t ci = 0; ci < chars; ci++, c = (struct npf_char *)((uintptr_t)c + charsz))
+    {
+        uint32_t num = c->num;
+
+        if (num > UNICODE_MAX)
+        {
+            report(PROBLEM_RANGE, num);
+            continue;
+        }
+
+        uint64_t bit = 1ULL << (num % 64);
+        if (seen[num / 64] & bit)
+        {
+            // Das erste Vorkommen gewinnt
+            report(PROBLEM_DUPLICATE, num);
+            continue;
+        }
+        seen[num / 64] |= bit;
+
+        if ((num < last) && sorted)
+        {
+            report(PROBLEM_ORDER, num);
+            sorted = false;
+        }
+        last = num;
+
+        if ((fw % 8) && stray_bits(c->rows, bad))
+        {
+            report(PROBLEM_BITS, num);
+            if (fix)
+                for (size_t i = 0; i < rowbytes; i++)
+                    c->rows[i] &= ~bad[i];
+        }
+
+        if (has_metrics)
+        {
+            struct npf_metrics *m = (struct npf_metrics *)&c->rows[rowbytes], ink;
+            ink_bounds(&ink, c->rows);
+
+            if ((m->ink_x != ink.ink_x) || (m->ink_y != ink.ink_y) || (m->ink_w != ink.ink_w) || (m->ink_h != ink.ink_h))
+            {
+                report(PROBLEM_METRICS, num);
+                if (fix)
+                {
+                    ink.advance = m->advance;
+                    *m = ink;
+                }
+            }
+        }
+
+        if (fix)
+            keep[kept++] = c;
+    }
+
+    unsigned long total = 0;
+    for (int p = 0; p < PROBLEMS; p++)
+    {
+        if (problems[p])
+            printf("%s: %lu\n", problem_desc[p], problems[p]);
+        total += problems[p];
+    }
+
+    if (!total)
+    {
+        printf("%zu Zeichen, keine Fehler gefunden.\n", chars);
+        return 0;
+    }
+
+    if (!fix)
+        return 1;
+
+    if (!sorted)
+        qsort(keep, kept, sizeof(*keep), char_comparison);
+
+    // Erst vollständig schreiben, dann ersetzen, damit bei einem Fehler die
+    // Eingabe erhalten bleibt
+    char tmp_name[strlen(out_name) + 5];
+    sprintf(tmp_name, "%s.neu", out_name);
+
+    fp = fopen(tmp_name, "wb");
+    if (fp == NULL)
+    {
+        perror(tmp_name);
+        return 1;
+    }
+
+    bool ok = fwrite(npfh, sizeof(*npfh), 1, fp) == 1;
+    for (size_t i = 0; ok && (i < kept); i++)
+        ok = fwrite(keep[i], charsz, 1, fp) == 1;
+
+    if ((fclose(fp) != 0) || !ok || rename(tmp_name, out_name))
+    {
+        perror(out_name);
+        remove(tmp_name);
+        return 1;
+    }
+
+    printf("%lu Fehler behoben, %zu von %zu Zeichen nach „%s“ geschrieben.\n", total, kept, chars, out_name);
+
+    free(keep);
+    free(bad);
+    free(npfh);
+
+    return 0;
+}
@@ -0,0 +1,610 @@
+#ifndef NPFFONT_H
+#define NPFFONT_H
+
+// Threadsicherer Lesezugriff auf NPF-Dateien mit Neuladen im laufenden
+// Betrieb. Benötigt _DEFAULT_SOURCE und -pthread.
+//
+// Eine struct npf_font verweist immer auf eine unveränderliche, gemappte
+// Fassung der Datei. Leser holen sich mit npf_font_acquire() eine Ansicht,
+// suchen darin ohne Sperren und geben sie mit npf_font_release() wieder frei;
+// alle Zeiger aus der Ansicht bleiben bis dahin gültig.
+//
+// npf_font_reload() mappt die Datei neu und tauscht die Fassung atomar aus.
+// Die alte wird erst freigegeben, wenn alle Leser, die sie noch sehen
+// konnten, ihre Ansicht zurückgegeben haben (wie bei RCU: Leser melden sich
+// in einem von zwei Zählern an, der Neulader schaltet die Epoche weiter und
+// wartet, bis der Zähler der alten Epoche leer ist). Ansichten sollten also
+// nur kurz gehalten werden.
+//
+// Dateien sollten per rename() ersetzt werden; wird eine gemappte Datei an
+// Ort und Stelle gekürzt, führen Zugriffe auf die alte Fassung zu SIGBUS.
+//
+// Mit npf_font_open_lazy() wird beim Öffnen nur der Kopf gelesen. Die
+// Zeichen werden in Blöcken zu je 256 Codepunkten beim ersten Zugriff per
+// pread() eingelesen (die Grenzen eines Blocks per binärer Suche über die
+// Unicodecodes in der Datei), sodass Startzeit und Speicherbedarf nicht von
+// der Größe der Schriftart abhängen. Dafür muss die Datei nach Unicodecode
+// sortiert sein, wie es npfmerge und edit schreiben (npfcheck -f sortiert
+// andere). Fällt beim Einlesen eines Blocks auf, dass sie es nicht ist, wird
+// diese Fassung stattdessen wie im sofortigen Modus gemappt; Unordnung, die
+// in keinem bisher gelesenen Block sichtbar wird, bleibt aber unbemerkt, und
+// Zeichen können dann fehlen.
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define NPF_FONT_BLOCK_SHIFT 8
+#define NPF_FONT_BLOCKS (0x110000 >> NPF_FONT_BLOCK_SHIFT)
+
+#ifndef NPF_LAYOUT
+#define NPF_LAYOUT
+
+struct npf
+{
+    char sig[3], version;
+    uint16_t height, width;
+    char name[24];
+} __attribute__((packed));
+
+struct npf_char
+{
+    uint32_t num;
+    uint8_t rows[];
+} __attribute__((packed));
+
+// Ab Version 3 folgen jedem Zeichen hinter den Zeilen seine Metriken
+struct npf_metrics
+{
+    uint8_t advance;
+    uint8_t ink_x, ink_y, ink_w, ink_h;
+} __attribute__((packed));
+
+#endif
+
+// Zusammenhängende Zeichen eines Blocks, ab Zeichenindex first
+struct npf_font_block
+{
+    size_t first, count;
+    uint8_t data[];
+};
+
+// Eine gemappte Fassung der Datei; wird nach dem Laden nie mehr verändert
+// (bis auf den Blockcache, dessen Einträge aber nur einmal gesetzt werden)
+struct npf_font_version
+{
+    const uint8_t *base;
+    size_t size;
+    const struct npf *hdr;
+    size_t charsz, chars;
+    // Nur bei unsortierten Dateien: Zeichenindizes nach Unicodecode sortiert
+    uint32_t *order;
+
+    // Nur im verzögerten Modus (base ist dann NULL)
+    struct npf hdr_copy;
+    int fd;
+    _Atomic(struct npf_font_block *) *blocks;
+    atomic_size_t resident_blocks, resident_bytes;
+    // Wird gesetzt, sobald ein Block nicht sortiert ist; ab dann wird in
+    // eager gesucht, einer sofort geladenen Fassung derselben Datei
+    atomic_bool unsorted;
+    _Atomic(struct npf_font_version *) eager;
+};
+
+struct npf_font
+{
+    char *path;
+    bool lazy;
+    _Atomic(struct npf_font_version *) current;
+
+    atomic_uint epoch;
+    atomic_uint readers[2];
+
+    // Serialisiert nur Neulader untereinander, nie Leser
+    pthread_mutex_t reload_lock;
+};
+
+struct npf_font_view
+{
+    const struct npf_font_version *v;
+    struct npf_font *font;
+    unsigned epoch;
+};
+
+struct npf_font_order
+{
+    uint32_t num, index;
+};
+
+static inline int npf_font_order_comparison(const void *x, const void *y)
+{
+    const struct npf_font_order *a = x, *b = y;
+    if (a->num != b->num)
+        return (a->num < b->num) ? -1 : 1;
+    // Bei gleichen Codes gewinnt das erste Vorkommen
+    return (a->index > b->index) - (a->index < b->index);
+}
+
+static inline const struct npf_char *npf_font_version_char(const struct npf_font_version *v, size_t i)
+{
+    return (const struct npf_char *)(v->base + sizeof(struct npf) + i * v->charsz);
+}
+
+static inline void npf_font_version_free(struct npf_font_version *v)
+{
+    if (v == NULL)
+        return;
+
+    if (v->blocks != NULL)
+    {
+        for (size_t i = 0; i < NPF_FONT_BLOCKS; i++)
+            free(atomic_load(&v->blocks[i]));
+        free(v->blocks);
+        npf_font_version_free(atomic_load(&v->eager));
+    }
+
+    if (v->base != NULL)
+        munmap((void *)v->base, v->size);
+    if (v->fd >= 0)
+        close(v->fd);
+
+    free(v->order);
+    free(v);
+}
+
+// Übernimmt fd; path dient nur den Fehlermeldungen
+static inline struct npf_font_version *npf_font_version_from_fd(int fd, const char *path, bool lazy)
+{
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        perror(path);
+        close(fd);
+        return NULL;
+    }
+
+    if ((size_t)st.st_size < sizeof(struct npf))
+    {
+        fprintf(stderr, "%s: Datei ist zu klein.\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    struct npf_font_version *v = calloc(1, sizeof(*v));
+    v->size = st.st_size;
+    v->fd = -1;
+
+    if (lazy)
+    {
+        v->fd = fd;
+        v->hdr = &v->hdr_copy;
+        if (pread(fd, &v->hdr_copy, sizeof(v->hdr_copy), 0) != sizeof(v->hdr_copy))
+        {
+            perror(path);
+            npf_font_version_free(v);
+            return NULL;
+        }
+    }
+    else
+    {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+        {
+            perror(path);
+            free(v);
+            return NULL;
+        }
+
+        v->base = map;
+        v->hdr = map;
+    }
+
+    if (strncmp(v->hdr->sig, "NPF", 3))
+    {
+        fprintf(stderr, "%s: Keine NPF-Datei.\n", path);
+        npf_font_version_free(v);
+        return NULL;
+    }
+
+    if ((v->hdr->version != '2') && (v->hdr->version != '3'))
+    {
+        fprintf(stderr, "%s: Nicht unterstützte Version.\n", path);
+        npf_font_version_free(v);
+        return NULL;
+    }
+
+    v->charsz = v->hdr->height * ((v->hdr->width + 7) / 8) + sizeof(uint32_t) +
+                ((v->hdr->version >= '3') ? sizeof(struct npf_metrics) : 0);
+
+    if ((v->size - sizeof(struct npf)) % v->charsz)
+    {
+        fprintf(stderr, "%s: Ungültige Dateigröße (kein Vielfaches der Zeichengröße).\n", path);
+        npf_font_version_free(v);
+        return NULL;
+    }
+
+    v->chars = (v->size - sizeof(struct npf)) / v->charsz;
+
+    if (v->chars > UINT32_MAX)
+    {
+        fprintf(stderr, "%s: Zu viele Zeichen.\n", path);
+        npf_font_version_free(v);
+        return NULL;
+    }
+
+    if (lazy)
+    {
+        v->blocks = calloc(NPF_FONT_BLOCKS, sizeof(*v->blocks));
+        atomic_init(&v->resident_blocks, 0);
+        atomic_init(&v->resident_bytes, 0);
+        atomic_init(&v->unsorted, false);
+        atomic_init(&v->eager, NULL);
+        return v;
+    }
+
+    // Sortierte Dateien (wie von npfmerge oder edit geschrieben) werden
+    // direkt durchsucht, sonst wird einmalig ein Index angelegt
+    bool is_sorted = true;
+    for (size_t i = 1; is_sorted && (i < v->chars); i++)
+        if (npf_font_version_char(v, i - 1)->num > npf_font_version_char(v, i)->num)
+            is_sorted = false;
+
+    if (!is_sorted)
+    {
+        struct npf_font_order *o = malloc(v->chars * sizeof(*o));
+        for (size_t i = 0; i < v->chars; i++)
+            o[i] = (struct npf_font_order){ .num = npf_font_version_char(v, i)->num, .index = i };
+
+        qsort(o, v->chars, sizeof(*o), npf_font_order_comparison);
+
+        v->order = malloc(v->chars * sizeof(*v->order));
+        for (size_t i = 0; i < v->chars; i++)
+            v->order[i] = o[i].index;
+        free(o);
+    }
+
+    return v;
+}
+
+static inline struct npf_font_version *npf_font_version_load(const char *path, bool lazy)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        perror(path);
+        return NULL;
+    }
+
+    return npf_font_version_from_fd(fd, path, lazy);
+}
+
+// Zeichen an Position i in Unicodereihenfolge, nur im sofortigen Modus
+static inline const struct npf_char *npf_font_version_sorted_char(const struct npf_font_version *v, size_t i)
+{
+    return npf_font_version_char(v, (v->order != NULL) ? v->order[i] : i);
+}
+
+static inline uint32_t npf_font_version_num(const struct npf_font_version *v, size_t i)
+{
+    uint32_t num = UINT32_MAX;
+    if (pread(v->fd, &num, sizeof(num), sizeof(struct npf) + i * v->charsz) != sizeof(num))
+        return UINT32_MAX;
+    return num;
+}
+
+// Erster Zeichenindex in [lo, hi) mit einem Code von mindestens unicode,
+// nur über die Unicodecodes in der Datei
+static inline size_t npf_font_version_lower_bound(const struct npf_font_version *v, size_t lo, size_t hi, uint32_t unicode)
+{
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (npf_font_version_num(v, mid) < unicode)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+// Gibt einen Block zurück und liest ihn beim ersten Zugriff ein. Laufen
+// mehrere Threads gleichzeitig in denselben Block, gewinnt der erste; die
+// anderen verwerfen ihre Kopie.
+static inline const struct npf_font_block *npf_font_version_block(struct npf_font_version *v, uint32_t block)
+{
+    struct npf_font_block *b = atomic_load_explicit(&v->blocks[block], memory_order_acquire);
+    if (b != NULL)
+        return b;
+
+    size_t first = npf_font_version_lower_bound(v, 0, v->chars, block << NPF_FONT_BLOCK_SHIFT);
+    size_t end = npf_font_version_lower_bound(v, first, v->chars, (block + 1) << NPF_FONT_BLOCK_SHIFT);
+
+    b = malloc(sizeof(*b) + (end - first) * v->charsz);
+    b->first = first;
+    b->count = end - first;
+
+    size_t len = b->count * v->charsz;
+    ssize_t got = pread(v->fd, b->data, len, sizeof(struct npf) + first * v->charsz);
+    if ((got < 0) || ((size_t)got != len))
+        b->count = 0;
+
+    // Die Suche in lookup setzt aufsteigende Codes innerhalb des Blocks
+    // voraus; sonst bleibt er leer und die Fassung gilt als unsortiert
+    uint32_t last = block << NPF_FONT_BLOCK_SHIFT;
+    for (size_t i = 0; i < b->count; i++)
+    {
+        uint32_t num = ((const struct npf_char *)(b->data + i * v->charsz))->num;
+        if ((num < last) || ((num >> NPF_FONT_BLOCK_SHIFT) != block))
+        {
+            b->count = 0;
+            atomic_store(&v->unsorted, true);
+            break;
+        }
+        last = num;
+    }
+
+    struct npf_font_block *expected = NULL;
+    if (!atomic_compare_exchange_strong_explicit(&v->blocks[block], &expected, b, memory_order_acq_rel, memory_order_acquire))
+    {
+        free(b);
+        return expected;
+    }
+
+    atomic_fetch_add_explicit(&v->resident_blocks, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&v->resident_bytes, (got > 0) ? (size_t)got : 0, memory_order_relaxed);
+
+    return b;
+}
+
+// Mappt die Datei hinter v->fd (also dieselbe Fassung, auch wenn sie
+// inzwischen ersetzt wurde) und legt dabei den Index an. Wie bei den Blöcken
+// gewinnt der erste Thread. Gibt NULL zurück, wenn das nicht gelingt.
+static inline const struct npf_font_version *npf_font_version_fallback(struct npf_font_version *v, const char *path)
+{
+    struct npf_font_version *e = atomic_load_explicit(&v->eager, memory_order_acquire);
+    if (e != NULL)
+        return e;
+
+    int fd = dup(v->fd);
+    if (fd < 0)
+    {
+        perror(path);
+        return NULL;
+    }
+
+    e = npf_font_version_from_fd(fd, path, false);
+    if (e == NULL)
+        return NULL;
+
+    struct npf_font_version *expected = NULL;
+    if (!atomic_compare_exchange_strong_explicit(&v->eager, &expected, e, memory_order_acq_rel, memory_order_acquire))
+    {
+        npf_font_version_free(e);
+        return expected;
+    }
+
+    fprintf(stderr, "%s: Datei ist nicht nach Code sortiert, sie wird stattdessen gemappt.\n", path);
+    return e;
+}
+
+// Die Fassung, in der gesucht wird: nach einem Rückfall die gemappte
+static inline const struct npf_font_version *npf_font_version_active(const struct npf_font_version *v)
+{
+    const struct npf_font_version *e = NULL;
+    if (v->blocks != NULL)
+        e = atomic_load_explicit(&((struct npf_font_version *)v)->eager, memory_order_acquire);
+    return (e != NULL) ? e : v;
+}
+
+static inline bool npf_font_open_mode(struct npf_font *f, const char *path, bool lazy)
+{
+    struct npf_font_version *v = npf_font_version_load(path, lazy);
+    if (v == NULL)
+        return false;
+
+    f->path = strdup(path);
+    f->lazy = lazy;
+    atomic_init(&f->current, v);
+    atomic_init(&f->epoch, 0);
+    atomic_init(&f->readers[0], 0);
+    atomic_init(&f->readers[1], 0);
+    pthread_mutex_init(&f->reload_lock, NULL);
+
+    return true;
+}
+
+static inline bool npf_font_open(struct npf_font *f, const char *path)
+{
+    return npf_font_open_mode(f, path, false);
+}
+
+static inline bool npf_font_open_lazy(struct npf_font *f, const char *path)
+{
+    return npf_font_open_mode(f, path, true);
+}
+
+// Darf erst aufgerufen werden, wenn kein Thread mehr eine Ansicht hält
+static inline void npf_font_close(struct npf_font *f)
+{
+    npf_font_version_free(atomic_load(&f->current));
+    pthread_mutex_destroy(&f->reload_lock);
+    free(f->path);
+}
+
+static inline void npf_font_acquire(struct npf_font *f, struct npf_font_view *view)
+{
+    // Anmelden und prüfen, ob die Epoche inzwischen weitergeschaltet wurde;
+    // in dem Fall wartet der Neulader eventuell schon nicht mehr auf uns
+    for (;;)
+    {
+        unsigned e = atomic_load(&f->epoch);
+        atomic_fetch_add(&f->readers[e & 1], 1);
+        if (atomic_load(&f->epoch) == e)
+        {
+            view->epoch = e;
+            break;
+        }
+        atomic_fetch_sub(&f->readers[e & 1], 1);
+    }
+
+    view->font = f;
+    view->v = atomic_load(&f->current);
+}
+
+static inline void npf_font_release(struct npf_font_view *view)
+{
+    atomic_fetch_sub_explicit(&view->font->readers[view->epoch & 1], 1, memory_order_release);
+    view->v = NULL;
+}
+
+// Lädt die Datei neu. Schlägt das fehl, bleibt die bisherige Fassung
+// erhalten. Blockiert, bis die alte Fassung von keinem Leser mehr verwendet
+// wird, und darf daher nicht mit einer gehaltenen Ansicht aufgerufen werden.
+static inline bool npf_font_reload(struct npf_font *f)
+{
+    struct npf_font_version *v = npf_font_version_load(f->path, f->lazy);
+    if (v == NULL)
+        return false;
+
+    pthread_mutex_lock(&f->reload_lock);
+
+    struct npf_font_version *old = atomic_exchange(&f->current, v);
+
+    unsigned e = atomic_fetch_add(&f->epoch, 1);
+    while (atomic_load_explicit(&f->readers[e & 1], memory_order_acquire))
+        sched_yield();
+
+    pthread_mutex_unlock(&f->reload_lock);
+
+    npf_font_version_free(old);
+
+    return true;
+}
+
+static inline const struct npf *npf_font_header(const struct npf_font_view *view)
+{
+    return view->v->hdr;
+}
+
+static inline size_t npf_font_chars(const struct npf_font_view *view)
+{
+    return view->v->chars;
+}
+
+// Liest im verzögerten Modus den Block zu block ein. Ist die Fassung als
+// unsortiert erkannt, wird stattdessen *v auf die gemappte umgestellt und
+// NULL zurückgegeben.
+static inline const struct npf_font_block *npf_font_view_block(const struct npf_font_view *view, const struct npf_font_version **v, uint32_t block)
+{
+    struct npf_font_version *lv = (struct npf_font_version *)*v;
+    const struct npf_font_block *b = npf_font_version_block(lv, block);
+    if (!atomic_load(&lv->unsorted))
+        return b;
+
+    const struct npf_font_version *e = npf_font_version_fallback(lv, view->font->path);
+    if (e == NULL)
+        return b;
+
+    *v = e;
+    return NULL;
+}
+
+// Gibt das Zeichen an Position i in Unicodereihenfolge zurück. Im
+// verzögerten Modus ist das NULL, wenn der Block nicht gelesen werden konnte;
+// im sofortigen Modus nie.
+static inline const struct npf_char *npf_font_char(const struct npf_font_view *view, size_t i)
+{
+    const struct npf_font_version *v = npf_font_version_active(view->v);
+
+    if (v->blocks != NULL)
+    {
+        uint32_t num = npf_font_version_num(v, i);
+        if ((num >> NPF_FONT_BLOCK_SHIFT) >= NPF_FONT_BLOCKS)
+            return NULL;
+
+        const struct npf_font_block *b = npf_font_view_block(view, &v, num >> NPF_FONT_BLOCK_SHIFT);
+        if (b != NULL)
+        {
+            if ((i < b->first) || (i - b->first >= b->count))
+                return NULL;
+            return (const struct npf_char *)(b->data + (i - b->first) * v->charsz);
+        }
+    }
+
+    return npf_font_version_sorted_char(v, i);
+}
+
+static inline const struct npf_char *npf_font_lookup(const struct npf_font_view *view, uint32_t unicode)
+{
+    const struct npf_font_version *v = npf_font_version_active(view->v);
+
+    if (v->blocks != NULL)
+    {
+        if ((unicode >> NPF_FONT_BLOCK_SHIFT) >= NPF_FONT_BLOCKS)
+            return NULL;
+
+        const struct npf_font_block *b = npf_font_view_block(view, &v, unicode >> NPF_FONT_BLOCK_SHIFT);
+        if (b != NULL)
+        {
+            size_t lo = 0, hi = b->count;
+            while (lo < hi)
+            {
+                size_t mid = lo + (hi - lo) / 2;
+                if (((const struct npf_char *)(b->data + mid * v->charsz))->num < unicode)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+
+            const struct npf_char *c = (const struct npf_char *)(b->data + lo * v->charsz);
+            return ((lo < b->count) && (c->num == unicode)) ? c : NULL;
+        }
+    }
+
+    size_t lo = 0, hi = v->chars;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (npf_font_version_sorted_char(v, mid)->num < unicode)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo >= v->chars)
+        return NULL;
+
+    const struct npf_char *c = npf_font_version_sorted_char(v, lo);
+    return (c->num == unicode) ? c : NULL;
+}
+
+// Metriken eines Zeichens, oder NULL bei Dateien der Version 2
+static inline const struct npf_metrics *npf_font_metrics(const struct npf_font_view *view, const struct npf_char *c)
+{
+    const struct npf *hdr = view->v->hdr;
+    if (hdr->version < '3')
+        return NULL;
+    return (const struct npf_metrics *)&c->rows[hdr->height * ((hdr->width + 7) / 8)];
+}
+
+// Anzahl und Größe der eingelesenen Blöcke der aktuellen Fassung (im
+// sofortigen Modus immer 0)
+static inline void npf_font_resident(const struct npf_font_view *view, size_t *blocks, size_t *bytes)
+{
+    struct npf_font_version *v = (struct npf_font_version *)view->v;
+    *blocks = atomic_load_explicit(&v->resident_blocks, memory_order_relaxed);
+    *bytes = atomic_load_explicit(&v->resident_bytes, memory_order_relaxed);
+}
+
+#endif
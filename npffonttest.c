@@ -0,0 +1,190 @@
+#define _DEFAULT_SOURCE
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "npffont.h"
+
+// Prüft npffont.h: Mehrere Threads suchen fortlaufend Zeichen in einer sofort
+// und einer verzögert geöffneten Schriftart und vergleichen die Ergebnisse,
+// während der Hauptthread beide immer wieder neu lädt. Zum Schluss werden
+// die Zähler der eingelesenen Blöcke geprüft.
+
+#define RELOADS 200
+
+static struct npf_font eager, lazy;
+static uint32_t *codes;
+static size_t code_count, record_size;
+
+static atomic_bool stop;
+static atomic_ulong lookups, mismatches;
+
+static void *reader(void *arg)
+{
+    unsigned seed = (unsigned)(uintptr_t)arg;
+
+    while (!atomic_load(&stop))
+    {
+        struct npf_font_view ev, lv;
+        npf_font_acquire(&eager, &ev);
+        npf_font_acquire(&lazy, &lv);
+
+        for (int i = 0; i < 64; i++)
+        {
+            seed = seed * 1103515245 + 12345;
+            uint32_t num = codes[(seed >> 8) % code_count];
+
+            const struct npf_char *ec = npf_font_lookup(&ev, num), *lc = npf_font_lookup(&lv, num);
+            if ((ec == NULL) || (lc == NULL) || memcmp(ec, lc, record_size))
+                atomic_fetch_add(&mismatches, 1);
+        }
+        atomic_fetch_add(&lookups, 64);
+
+        npf_font_release(&lv);
+        npf_font_release(&ev);
+    }
+
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned threads = 4;
+
+    if ((argc < 2) || (argc > 3))
+    {
+        fprintf(stderr, "Benutzung: npffonttest <npf> [Threads]\n");
+        return 1;
+    }
+
+    if (argc > 2)
+    {
+        char *tmp;
+        threads = strtoul(argv[2], &tmp, 0);
+        if (*tmp || !threads)
+        {
+            fprintf(stderr, "Ungültige Anzahl Threads „%s“.\n", argv[2]);
+            return 1;
+        }
+    }
+
+    if (!npf_font_open(&eager, argv[1]))
+        return 1;
+    if (!npf_font_open_lazy(&lazy, argv[1]))
+        return 1;
+
+    struct npf_font_view view;
+    npf_font_acquire(&eager, &view);
+
+    const struct npf *hdr = npf_font_header(&view);
+    record_size = view.v->charsz;
+    size_t chars = npf_font_chars(&view);
+
+    // Nur Codes, die in einem Block liegen können; Doppelte zählen einmal
+    codes = malloc((chars ? chars : 1) * sizeof(*codes));
+    size_t in_blocks = 0;
+    for (size_t i = 0; i < chars; i++)
+    {
+        uint32_t num = npf_font_char(&view, i)->num;
+        if ((num >> NPF_FONT_BLOCK_SHIFT) >= NPF_FONT_BLOCKS)
+            continue;
+        in_blocks++;
+        if (!code_count || (codes[code_count - 1] != num))
+            codes[code_count++] = num;
+    }
+
+    npf_font_release(&view);
+
+    if (!code_count)
+    {
+        fprintf(stderr, "Die Schriftart enthält keine Zeichen.\n");
+        return 1;
+    }
+
+    printf("%s: %u×%u, %zu Zeichen, %u Threads, %u Neuladevorgänge\n", argv[1], hdr->width, hdr->height, chars, threads, RELOADS);
+
+    atomic_init(&stop, false);
+    atomic_init(&lookups, 0);
+    atomic_init(&mismatches, 0);
+
+    pthread_t *tids = malloc(threads * sizeof(*tids));
+    for (unsigned t = 0; t < threads; t++)
+        pthread_create(&tids[t], NULL, reader, (void *)(uintptr_t)(t + 1));
+
+    bool ok = true;
+    for (int r = 0; ok && (r < RELOADS); r++)
+    {
+        ok = npf_font_reload(&eager) && npf_font_reload(&lazy);
+        nanosleep(&(struct timespec){ .tv_nsec = 1000000 }, NULL);
+    }
+
+    atomic_store(&stop, true);
+    for (unsigned t = 0; t < threads; t++)
+        pthread_join(tids[t], NULL);
+    free(tids);
+
+    if (!ok)
+    {
+        fprintf(stderr, "Neuladen fehlgeschlagen.\n");
+        return 1;
+    }
+
+    printf("%lu Suchen, %lu Abweichungen\n", atomic_load(&lookups), atomic_load(&mismatches));
+    if (atomic_load(&mismatches))
+        ok = false;
+
+    // Frisch geladen ist noch nichts eingelesen; einmal jeden Code gesucht,
+    // muss jedes Zeichen genau einmal im Speicher liegen
+    if (!npf_font_reload(&lazy))
+    {
+        fprintf(stderr, "Neuladen fehlgeschlagen.\n");
+        return 1;
+    }
+
+    size_t blocks, bytes;
+    npf_font_acquire(&lazy, &view);
+    npf_font_resident(&view, &blocks, &bytes);
+    if (blocks || bytes)
+    {
+        fprintf(stderr, "Frisch geladen, aber schon %zu Blöcke (%zu Bytes) eingelesen.\n", blocks, bytes);
+        ok = false;
+    }
+
+    for (size_t i = 0; i < code_count; i++)
+        npf_font_lookup(&view, codes[i]);
+    npf_font_resident(&view, &blocks, &bytes);
+
+    if (atomic_load(&view.v->eager) != NULL)
+        printf("Datei ist nicht sortiert, die Zähler werden nicht geprüft.\n");
+    else if (bytes != in_blocks * record_size)
+    {
+        fprintf(stderr, "%zu Bytes eingelesen, erwartet waren %zu.\n", bytes, in_blocks * record_size);
+        ok = false;
+    }
+    else
+        printf("%zu Blöcke mit %zu Bytes eingelesen\n", blocks, bytes);
+
+    npf_font_release(&view);
+
+    npf_font_acquire(&eager, &view);
+    npf_font_resident(&view, &blocks, &bytes);
+    if (blocks || bytes)
+    {
+        fprintf(stderr, "Im sofortigen Modus %zu Blöcke (%zu Bytes) eingelesen.\n", blocks, bytes);
+        ok = false;
+    }
+    npf_font_release(&view);
+
+    npf_font_close(&lazy);
+    npf_font_close(&eager);
+    free(codes);
+
+    printf("%s\n", ok ? "Keine Fehler gefunden." : "Fehler gefunden.");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,257 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct npf
+{
+    char sig[3], version;
+    uint16_t height, width;
+    char name[24];
+} __attribute__((packed));
+
+struct npf_char
+{
+    uint32_t num;
+    uint8_t rows[];
+} __attribute__((packed));
+
+// Ab Version 3 folgen jedem Zeichen hinter den Zeilen seine Metriken
+struct npf_metrics
+{
+    uint8_t advance;
+    uint8_t ink_x, ink_y, ink_w, ink_h;
+} __attribute__((packed));
+
+struct input
+{
+    const char *fname;
+    struct npf *npfh;
+    const struct npf_char **sorted;
+    size_t chars, pos;
+};
+
+static size_t charsz;
+
+static bool load_input(struct input *in, const char *name)
+{
+    in->fname = name;
+
+    FILE *fp = fopen(name, "rb");
+    if (fp == NULL)
+    {
+        perror(name);
+        return false;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    size_t filesz = ftell(fp);
+    rewind(fp);
+
+    if (filesz < sizeof(struct npf))
+    {
+        fprintf(stderr, "%s: Datei ist zu klein.\n", name);
+        fclose(fp);
+        return false;
+    }
+
+    in->npfh = malloc(filesz);
+    fread(in->npfh, filesz, 1, fp);
+    fclose(fp);
+
+    if (strncmp(in->npfh->sig, "NPF", 3))
+    {
+        fprintf(stderr, "%s: Keine NPF-Datei.\n", name);
+        return false;
+    }
+
+    if ((in->npfh->version != '2') && (in->npfh->version != '3'))
+    {
+        fprintf(stderr, "%s: Nicht unterstützte Version.\n", name);
+        return false;
+    }
+
+    size_t csz = in->npfh->height * ((in->npfh->width + 7) / 8) + sizeof(uint32_t) +
+                 ((in->npfh->version >= '3') ? sizeof(struct npf_metrics) : 0);
+    if (!charsz)
+        charsz = csz;
+
+    if ((filesz - sizeof(struct npf)) % csz)
+    {
+        fprintf(stderr, "%s: Ungültige Dateigröße (kein Vielfaches der Zeichengröße).\n", name);
+        return false;
+    }
+
+    in->chars = (filesz - sizeof(struct npf)) / csz;
+    in->pos = 0;
+
+    return true;
+}
+
+// Sortiert die Zeichen einer Eingabe stabil nach Unicodecode (LSD-Radixsort
+// über zwei 16-Bit-Stellen, also in linearer Zeit). Bereits sortierte Dateien
+// werden direkt übernommen.
+static void sort_input(struct input *in)
+{
+    const struct npf_char **list = malloc(in->chars * sizeof(*list));
+
+    bool is_sorted = true;
+    const struct npf_char *c = (const struct npf_char *)(in->npfh + 1);
+    for (size_t i = 0; i < in->chars; i++)
+    {
+        list[i] = c;
+        if (i && (list[i - 1]->num > c->num))
+            is_sorted = false;
+        c = (const struct npf_char *)((uintptr_t)c + charsz);
+    }
+
+    if (!is_sorted)
+    {
+        const struct npf_char **tmp = malloc(in->chars * sizeof(*tmp));
+        size_t *count = malloc(65537 * sizeof(*count));
+
+        for (int shift = 0; shift < 32; shift += 16)
+        {
+            memset(count, 0, 65537 * sizeof(*count));
+            for (size_t i = 0; i < in->chars; i++)
+                count[((list[i]->num >> shift) & 0xFFFF) + 1]++;
+            for (size_t i = 1; i <= 65536; i++)
+                count[i] += count[i - 1];
+            for (size_t i = 0; i < in->chars; i++)
+                tmp[count[(list[i]->num >> shift) & 0xFFFF]++] = list[i];
+
+            const struct npf_char **swp = list;
+            list = tmp;
+            tmp = swp;
+        }
+
+        free(count);
+        free(tmp);
+    }
+
+    in->sorted = list;
+}
+
+int main(int argc, char *argv[])
+{
+    bool report = false, strict = false;
+
+    while ((argc > 1) && (argv[1][0] == '-'))
+    {
+        if (!strcmp(argv[1], "-k"))
+            report = true;
+        else if (!strcmp(argv[1], "-s"))
+            strict = report = true;
+        else
+        {
+            fprintf(stderr, "Unbekannte Option „%s“.\n", argv[1]);
+            return 1;
+        }
+
+        argc--;
+        argv++;
+    }
+
+    if (argc < 3)
+    {
+        fprintf(stderr, "Benutzung: npfmerge [-k] [-s] <Ausgabe> <npf>...\n");
+        fprintf(stderr, "Die Eingaben werden nach absteigender Priorität angegeben.\n");
+        fprintf(stderr, " -k: Konflikte auflisten\n");
+        fprintf(stderr, " -s: Bei Konflikten abbrechen\n");
+        return 1;
+    }
+
+    int inputs = argc - 2;
+    struct input *in = calloc(inputs, sizeof(*in));
+
+    for (int i = 0; i < inputs; i++)
+    {
+        if (!load_input(&in[i], argv[i + 2]))
+            return 1;
+
+        if ((in[i].npfh->width != in[0].npfh->width) || (in[i].npfh->height != in[0].npfh->height))
+        {
+            fprintf(stderr, "%s: Abweichende Zeichengröße (%u×%u statt %u×%u).\n", in[i].fname,
+                    in[i].npfh->width, in[i].npfh->height, in[0].npfh->width, in[0].npfh->height);
+            return 1;
+        }
+
+        if (in[i].npfh->version != in[0].npfh->version)
+        {
+            fprintf(stderr, "%s: Abweichende Version (%c statt %c).\n", in[i].fname, in[i].npfh->version, in[0].npfh->version);
+            return 1;
+        }
+
+        sort_input(&in[i]);
+    }
+
+    size_t total = 0;
+    for (int i = 0; i < inputs; i++)
+        total += in[i].chars;
+
+    // Für jeden Code gewinnt die erste Eingabe, die ihn enthält; Zeichen
+    // gelten nur dann als gleich, wenn auch ihre Metriken übereinstimmen
+    const struct npf_char **out = malloc(total * sizeof(*out));
+    size_t out_chars = 0, conflicts = 0;
+    size_t rowsz = charsz - sizeof(uint32_t);
+
+    for (;;)
+    {
+        int best = -1;
+        for (int i = 0; i < inputs; i++)
+            if ((in[i].pos < in[i].chars) && ((best < 0) || (in[i].sorted[in[i].pos]->num < in[best].sorted[in[best].pos]->num)))
+                best = i;
+
+        if (best < 0)
+            break;
+
+        const struct npf_char *c = in[best].sorted[in[best].pos];
+        out[out_chars++] = c;
+
+        for (int i = best; i < inputs; i++)
+        {
+            while ((in[i].pos < in[i].chars) && (in[i].sorted[in[i].pos]->num == c->num))
+            {
+                const struct npf_char *d = in[i].sorted[in[i].pos++];
+                if ((d == c) || !memcmp(d->rows, c->rows, rowsz))
+                    continue;
+
+                conflicts++;
+                if (report)
+                    fprintf(stderr, "Konflikt bei U+%04X: %s hat Vorrang vor %s.\n", (unsigned)c->num, in[best].fname, in[i].fname);
+            }
+        }
+    }
+
+    if (strict && conflicts)
+    {
+        fprintf(stderr, "%zu Konflikt(e), Abbruch.\n", conflicts);
+        return 1;
+    }
+
+    FILE *fp = fopen(argv[1], "wb");
+    if (fp == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    fwrite(in[0].npfh, sizeof(struct npf), 1, fp);
+    for (size_t i = 0; i < out_chars; i++)
+        fwrite(out[i], charsz, 1, fp);
+
+    fclose(fp);
+
+    printf("%zu Zeichen aus %i Dateien zusammengeführt (%zu Konflikt(e)).\n", out_chars, inputs, conflicts);
+
+    for (int i = 0; i < inputs; i++)
+    {
+        free(in[i].sorted);
+        free(in[i].npfh);
+    }
+    free(in);
+    free(out);
+
+    return 0;
+}
@@ -0,0 +1,234 @@
+#define _DEFAULT_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "npfpack.h"
+
+struct face
+{
+    struct npf *npfh;
+    const struct npf_char **sorted;
+    size_t chars, charsz;
+};
+
+static int npf_char_comparison(const void *x, const void *y)
+{
+    const struct npf_char *cx = *(const struct npf_char **)x, *cy = *(const struct npf_char **)y;
+    if (cx->num != cy->num)
+        return (cx->num < cy->num) ? -1 : 1;
+    // Bei gleichen Codes gewinnt das erste Vorkommen: Die Zeiger zeigen in
+    // die Datei, ihre Reihenfolge ist also die der Datei
+    return (cx < cy) ? -1 : (cx > cy);
+}
+
+static int entry_comparison(const void *x, const void *y)
+{
+    const struct npfpack_entry *a = x, *b = y;
+    if (a->num != b->num)
+        return (a->num < b->num) ? -1 : 1;
+    return (int)a->face - (int)b->face;
+}
+
+static bool load_face(struct face *f, const char *name)
+{
+    FILE *fp = fopen(name, "rb");
+    if (fp == NULL)
+    {
+        perror(name);
+        return false;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    size_t filesz = ftell(fp);
+    rewind(fp);
+
+    if (filesz < sizeof(struct npf))
+    {
+        fprintf(stderr, "%s: Datei ist zu klein.\n", name);
+        fclose(fp);
+        return false;
+    }
+
+    f->npfh = malloc(filesz);
+    fread(f->npfh, filesz, 1, fp);
+    fclose(fp);
+
+    if (strncmp(f->npfh->sig, "NPF", 3))
+    {
+        fprintf(stderr, "%s: Keine NPF-Datei.\n", name);
+        return false;
+    }
+
+    if ((f->npfh->version != '2') && (f->npfh->version != '3'))
+    {
+        fprintf(stderr, "%s: Nicht unterstützte Version.\n", name);
+        return false;
+    }
+
+    f->charsz = f->npfh->height * ((f->npfh->width + 7) / 8) + sizeof(uint32_t) +
+                ((f->npfh->version >= '3') ? sizeof(struct npf_metrics) : 0);
+
+    if ((filesz - sizeof(struct npf)) % f->charsz)
+    {
+        fprintf(stderr, "%s: Ungültige Dateigröße (kein Vielfaches der Zeichengröße).\n", name);
+        return false;
+    }
+
+    size_t chars = (filesz - sizeof(struct npf)) / f->charsz;
+    f->sorted = malloc(chars * sizeof(*f->sorted));
+
+    const struct npf_char *c = (const struct npf_char *)(f->npfh + 1);
+    for (size_t i = 0; i < chars; i++)
+    {
+        f->sorted[i] = c;
+        c = (const struct npf_char *)((uintptr_t)c + f->charsz);
+    }
+
+    qsort(f->sorted, chars, sizeof(*f->sorted), npf_char_comparison);
+
+    // Doppelte Codes entfernen
+    f->chars = 0;
+    for (size_t i = 0; i < chars; i++)
+        if (!f->chars || (f->sorted[f->chars - 1]->num != f->sorted[i]->num))
+            f->sorted[f->chars++] = f->sorted[i];
+
+    return true;
+}
+
+static void pad_to(FILE *fp, size_t *pos, size_t align)
+{
+    static const uint8_t zero[NPFPACK_ALIGN];
+    size_t pad = (align - *pos % align) % align;
+    fwrite(zero, 1, pad, fp);
+    *pos += pad;
+}
+
+static int list_pack(const char *name)
+{
+    struct npfpack_file p;
+    if (!npfpack_open(&p, name))
+        return 1;
+
+    printf("%u Schnitte, %u Indexeinträge:\n", (unsigned)p.hdr->faces, (unsigned)p.hdr->entries);
+    for (uint32_t i = 0; i < p.hdr->faces; i++)
+    {
+        const struct npfpack_face *f = &p.faces[i];
+        printf(" [%u] „%.24s“ (%u×%u, %u Zeichen, Version %c)\n", (unsigned)i, f->name, f->width, f->height, (unsigned)f->chars, f->version);
+    }
+
+    npfpack_close(&p);
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if ((argc == 3) && !strcmp(argv[1], "-l"))
+        return list_pack(argv[2]);
+
+    if (argc < 3)
+    {
+        fprintf(stderr, "Benutzung: npfpack <Paket> <npf>...\n");
+        fprintf(stderr, "           npfpack -l <Paket>\n");
+        return 1;
+    }
+
+    unsigned faces = argc - 2;
+    if (faces > UINT16_MAX)
+    {
+        fprintf(stderr, "Zu viele Schnitte.\n");
+        return 1;
+    }
+
+    struct face *f = calloc(faces, sizeof(*f));
+    size_t entries = 0;
+
+    for (unsigned i = 0; i < faces; i++)
+    {
+        if (!load_face(&f[i], argv[i + 2]))
+            return 1;
+        entries += f[i].chars;
+    }
+
+    struct npfpack_entry *index = malloc(entries * sizeof(*index));
+    size_t ei = 0;
+    for (unsigned i = 0; i < faces; i++)
+    {
+        for (size_t j = 0; j < f[i].chars; j++)
+        {
+            index[ei++] = (struct npfpack_entry){
+                .num = f[i].sorted[j]->num,
+                .face = i,
+                .index = j
+            };
+        }
+    }
+
+    qsort(index, entries, sizeof(*index), entry_comparison);
+
+    struct npfpack hdr = {
+        .sig = "NPK",
+        .version = '2',
+        .faces = faces,
+        .entries = entries,
+        .index_offset = sizeof(struct npfpack) + faces * sizeof(struct npfpack_face)
+    };
+
+    struct npfpack_face *ft = calloc(faces, sizeof(*ft));
+    size_t pos = hdr.index_offset + entries * sizeof(*index);
+    for (unsigned i = 0; i < faces; i++)
+    {
+        pos = (pos + NPFPACK_ALIGN - 1) & ~(size_t)(NPFPACK_ALIGN - 1);
+        ft[i].offset = pos;
+        ft[i].chars = f[i].chars;
+        ft[i].height = f[i].npfh->height;
+        ft[i].width = f[i].npfh->width;
+        ft[i].version = f[i].npfh->version;
+        memcpy(ft[i].name, f[i].npfh->name, 24);
+        pos += f[i].chars * f[i].charsz;
+    }
+
+    if (pos > UINT32_MAX)
+    {
+        fprintf(stderr, "Paket wäre zu groß.\n");
+        return 1;
+    }
+
+    FILE *fp = fopen(argv[1], "wb");
+    if (fp == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+    fwrite(ft, sizeof(*ft), faces, fp);
+    fwrite(index, sizeof(*index), entries, fp);
+
+    pos = hdr.index_offset + entries * sizeof(*index);
+    for (unsigned i = 0; i < faces; i++)
+    {
+        pad_to(fp, &pos, NPFPACK_ALIGN);
+        for (size_t j = 0; j < f[i].chars; j++)
+            fwrite(f[i].sorted[j], f[i].charsz, 1, fp);
+        pos += f[i].chars * f[i].charsz;
+    }
+
+    fclose(fp);
+
+    printf("%u Schnitte mit %zu Zeichen gepackt.\n", faces, entries);
+
+    for (unsigned i = 0; i < faces; i++)
+    {
+        free(f[i].sorted);
+        free(f[i].npfh);
+    }
+    free(f);
+    free(ft);
+    free(index);
+
+    return 0;
+}
@@ -0,0 +1,231 @@
+#ifndef NPFPACK_H
+#define NPFPACK_H
+
+// Lesezugriff auf NPF-Pakete (mehrere Schriftschnitte in einer Datei).
+// Benötigt _DEFAULT_SOURCE (für madvise()).
+//
+// Aufbau (alle Werte little endian):
+//  - struct npfpack
+//  - struct npfpack_face[faces]
+//  - struct npfpack_entry[entries]: gemeinsamer Index aller Schnitte,
+//    sortiert nach (Unicodecode, Schnitt)
+//  - je Schnitt ein nach Unicodecode sortiertes Feld von struct npf_char
+//    (ab NPF-Version 3 mit Metriken), jeweils an NPFPACK_ALIGN ausgerichtet
+//
+// Die Datei wird einmal gemappt; Zeichendaten werden erst beim Zugriff
+// eingelagert.
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define NPFPACK_ALIGN 4096
+
+#ifndef NPF_LAYOUT
+#define NPF_LAYOUT
+
+struct npf
+{
+    char sig[3], version;
+    uint16_t height, width;
+    char name[24];
+} __attribute__((packed));
+
+struct npf_char
+{
+    uint32_t num;
+    uint8_t rows[];
+} __attribute__((packed));
+
+// Ab Version 3 folgen jedem Zeichen hinter den Zeilen seine Metriken
+struct npf_metrics
+{
+    uint8_t advance;
+    uint8_t ink_x, ink_y, ink_w, ink_h;
+} __attribute__((packed));
+
+#endif
+
+struct npfpack
+{
+    char sig[3], version;
+    uint32_t faces, entries;
+    uint32_t index_offset;
+} __attribute__((packed));
+
+struct npfpack_face
+{
+    uint32_t offset, chars;
+    uint16_t height, width;
+    char name[24];
+    char version;
+    uint8_t rsvd[3];
+} __attribute__((packed));
+
+struct npfpack_entry
+{
+    uint32_t num;
+    uint16_t face, rsvd;
+    uint32_t index;
+} __attribute__((packed));
+
+struct npfpack_file
+{
+    const uint8_t *base;
+    size_t size;
+    const struct npfpack *hdr;
+    const struct npfpack_face *faces;
+    const struct npfpack_entry *index;
+};
+
+static inline size_t npfpack_charsz(const struct npfpack_face *f)
+{
+    return f->height * ((f->width + 7) / 8) + sizeof(uint32_t) +
+           ((f->version >= '3') ? sizeof(struct npf_metrics) : 0);
+}
+
+static inline void npfpack_close(struct npfpack_file *p)
+{
+    if (p->base != NULL)
+        munmap((void *)p->base, p->size);
+    p->base = NULL;
+}
+
+static inline bool npfpack_open(struct npfpack_file *p, const char *name)
+{
+    p->base = NULL;
+
+    int fd = open(name, O_RDONLY);
+    if (fd < 0)
+    {
+        perror(name);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        perror(name);
+        close(fd);
+        return false;
+    }
+
+    p->size = st.st_size;
+    if (p->size < sizeof(struct npfpack))
+    {
+        fprintf(stderr, "Datei ist zu klein.\n");
+        close(fd);
+        return false;
+    }
+
+    void *map = mmap(NULL, p->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        perror(name);
+        return false;
+    }
+
+    p->base = map;
+    p->hdr = map;
+
+    if (strncmp(p->hdr->sig, "NPK", 3))
+    {
+        fprintf(stderr, "Kein NPF-Paket.\n");
+        npfpack_close(p);
+        return false;
+    }
+
+    if (p->hdr->version != '2')
+    {
+        fprintf(stderr, "Nicht unterstützte Version.\n");
+        npfpack_close(p);
+        return false;
+    }
+
+    size_t faces_end = sizeof(struct npfpack) + (size_t)p->hdr->faces * sizeof(struct npfpack_face);
+    size_t index_end = (size_t)p->hdr->index_offset + (size_t)p->hdr->entries * sizeof(struct npfpack_entry);
+
+    if ((faces_end > p->size) || (p->hdr->index_offset < faces_end) || (index_end > p->size))
+    {
+        fprintf(stderr, "Beschädigtes NPF-Paket.\n");
+        npfpack_close(p);
+        return false;
+    }
+
+    p->faces = (const struct npfpack_face *)(p->hdr + 1);
+    p->index = (const struct npfpack_entry *)(p->base + p->hdr->index_offset);
+
+    for (uint32_t i = 0; i < p->hdr->faces; i++)
+    {
+        if ((size_t)p->faces[i].offset + p->faces[i].chars * npfpack_charsz(&p->faces[i]) > p->size)
+        {
+            fprintf(stderr, "Beschädigtes NPF-Paket (Schnitt %u).\n", (unsigned)i);
+            npfpack_close(p);
+            return false;
+        }
+    }
+
+    // Der Index wird bei jeder Suche durchlaufen, die Zeichendaten nur punktuell
+    madvise((void *)p->base, p->size, MADV_RANDOM);
+    madvise((void *)p->base, index_end & ~(size_t)(NPFPACK_ALIGN - 1), MADV_WILLNEED);
+
+    return true;
+}
+
+// Gibt den Schnitt mit dem angegebenen Namen zurück (ohne auffüllende
+// Leerzeichen), oder -1.
+static inline int npfpack_find_face(const struct npfpack_file *p, const char *name)
+{
+    size_t len = strlen(name);
+    if (len > 24)
+        return -1;
+
+    for (uint32_t i = 0; i < p->hdr->faces; i++)
+    {
+        const char *fn = p->faces[i].name;
+        if (!strncmp(fn, name, len) && ((len == 24) || (fn[len] == ' ') || !fn[len]))
+            return i;
+    }
+
+    return -1;
+}
+
+static inline const struct npf_char *npfpack_char(const struct npfpack_file *p, unsigned face, uint32_t index)
+{
+    const struct npfpack_face *f = &p->faces[face];
+    return (const struct npf_char *)(p->base + f->offset + index * npfpack_charsz(f));
+}
+
+static inline const struct npf_char *npfpack_lookup(const struct npfpack_file *p, unsigned face, uint32_t unicode)
+{
+    if (face >= p->hdr->faces)
+        return NULL;
+
+    size_t lo = 0, hi = p->hdr->entries;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        const struct npfpack_entry *e = &p->index[mid];
+        if ((e->num < unicode) || ((e->num == unicode) && (e->face < face)))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo >= p->hdr->entries)
+        return NULL;
+
+    const struct npfpack_entry *e = &p->index[lo];
+    if ((e->num != unicode) || (e->face != face) || (e->index >= p->faces[face].chars))
+        return NULL;
+
+    return npfpack_char(p, face, e->index);
+}
+
+#endif
@@ -0,0 +1,164 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scale.h"
+#include "stream.h"
+
+struct npf
+{
+    char sig[3], version;
+    uint16_t height, width;
+    char name[24];
+} __attribute__((packed));
+
+struct npf_char
+{
+    uint32_t num;
+    uint8_t rows[];
+} __attribute__((packed));
+
+// Ab Version 3 folgen jedem Zeichen hinter den Zeilen seine Metriken
+struct npf_metrics
+{
+    uint8_t advance;
+    uint8_t ink_x, ink_y, ink_w, ink_h;
+} __attribute__((packed));
+
+int main(int argc, char *argv[])
+{
+    if (argc < 4)
+    {
+        fprintf(stderr, "Benutzung: npfscale <Faktor> <npf> <npf>\n");
+        fprintf(stderr, "„-“ steht für die Standardein- bzw. -ausgabe.\n");
+        return 1;
+    }
+
+    char *tmp;
+    unsigned n = strtoul(argv[1], &tmp, 0);
+    if (*tmp || (n < 1) || (n > SCALE_MAX))
+    {
+        fprintf(stderr, "Ungültiger Faktor (1 bis %i).\n", SCALE_MAX);
+        return 1;
+    }
+
+    FILE *in = stream_open(argv[2], "rb");
+    if (in == NULL)
+        return 1;
+
+    size_t filesz;
+    struct npf *npfh = stream_read_all(in, &filesz);
+    if (npfh == NULL)
+    {
+        fprintf(stderr, "%s: Lesefehler.\n", argv[2]);
+        return 1;
+    }
+    fclose(in);
+
+    if (filesz < sizeof(struct npf))
+    {
+        fprintf(stderr, "Datei ist zu klein.\n");
+        return 1;
+    }
+
+    if (strncmp(npfh->sig, "NPF", 3))
+    {
+        fprintf(stderr, "Keine NPF-Datei.\n");
+        return 1;
+    }
+
+    if ((npfh->version != '2') && (npfh->version != '3'))
+    {
+        fprintf(stderr, "Nicht unterstützte Version.\n");
+        return 1;
+    }
+
+    unsigned fw = npfh->width, fh = npfh->height;
+    size_t rowsz = (fw + 7) / 8;
+    size_t metricsz = (npfh->version >= '3') ? sizeof(struct npf_metrics) : 0;
+    size_t charsz = fh * rowsz + sizeof(uint32_t) + metricsz;
+
+    if ((filesz - sizeof(struct npf)) % charsz)
+    {
+        fprintf(stderr, "Ungültige Dateigröße (kein Vielfaches der Zeichengröße).\n");
+        return 1;
+    }
+
+    if (fw * n > UINT16_MAX || fh * n > UINT16_MAX)
+    {
+        fprintf(stderr, "Skalierte Schriftart wäre zu groß.\n");
+        return 1;
+    }
+
+    unsigned chars = (filesz - sizeof(struct npf)) / charsz;
+
+    if (metricsz && ((fw * n > UINT8_MAX) || (fh * n > UINT8_MAX)))
+    {
+        fprintf(stderr, "Zeichen werden zu groß für Metriken, schreibe Version 2.\n");
+        metricsz = 0;
+    }
+
+    size_t out_rowsz = (fw * n + 7) / 8;
+    size_t out_charsz = fh * n * out_rowsz + sizeof(uint32_t) + metricsz;
+
+    FILE *out = stream_open(argv[3], "wb");
+    if (out == NULL)
+        return 1;
+
+    struct npf outh = *npfh;
+    outh.version = metricsz ? '3' : '2';
+    outh.width = fw * n;
+    outh.height = fh * n;
+
+    fwrite(&outh, sizeof(outh), 1, out);
+
+    scale_init();
+
+    // Zwischenpuffer für eine Zeile ist rowsz * n groß, davon werden aber nur
+    // out_rowsz Bytes übernommen
+    uint8_t *row = malloc(rowsz * n);
+    struct npf_char *oc = malloc(out_charsz);
+
+    const struct npf_char *c = (const struct npf_char *)(npfh + 1);
+    for (unsigned ci = 0; ci < chars; ci++)
+    {
+        oc->num = c->num;
+
+        uint8_t *dst = oc->rows;
+        for (unsigned y = 0; y < fh; y++)
+        {
+            scale_row(row, &c->rows[y * rowsz], rowsz, n);
+            for (unsigned ry = 0; ry < n; ry++)
+            {
+                memcpy(dst, row, out_rowsz);
+                dst += out_rowsz;
+            }
+        }
+
+        if (metricsz)
+        {
+            const struct npf_metrics *m = (const struct npf_metrics *)&c->rows[fh * rowsz];
+            struct npf_metrics *om = (struct npf_metrics *)dst;
+            unsigned adv = m->advance * n;
+            om->advance = (adv > UINT8_MAX) ? UINT8_MAX : adv;
+            om->ink_x = m->ink_x * n;
+            om->ink_y = m->ink_y * n;
+            om->ink_w = m->ink_w * n;
+            om->ink_h = m->ink_h * n;
+        }
+
+        fwrite(oc, out_charsz, 1, out);
+
+        c = (const struct npf_char *)((uintptr_t)c + charsz);
+    }
+
+    fprintf(stream_messages(out), "%u Zeichen auf %u×%u skaliert.\n", chars, fw * n, fh * n);
+
+    fclose(out);
+    free(oc);
+    free(row);
+    free(npfh);
+
+    return 0;
+}
@@ -0,0 +1,303 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct npf
+{
+    char sig[3], version;
+    uint16_t height, width;
+    char name[24];
+} __attribute__((packed));
+
+struct npf_char
+{
+    uint32_t num;
+    uint8_t rows[];
+} __attribute__((packed));
+
+// Ab Version 3 folgen jedem Zeichen hinter den Zeilen seine Metriken
+struct npf_metrics
+{
+    uint8_t advance;
+    uint8_t ink_x, ink_y, ink_w, ink_h;
+} __attribute__((packed));
+
+enum style
+{
+    STYLE_BOLD,
+    STYLE_OBLIQUE,
+    STYLE_OUTLINE,
+    STYLE_UNDERLINE,
+
+    STYLES
+};
+
+static const char *const style_option[STYLES] = { "-b", "-i", "-o", "-u" };
+static const char *const style_name[STYLES] = { "Bold", "Oblique", "Outline", "Underline" };
+
+// Da jede Zeile ein Byte ist, werden immer acht Zeilen auf einmal als ein
+// 64-Bit-Wort verarbeitet; Verschiebungen um ein Pixel dürfen dabei nicht
+// in die Nachbarzeile überlaufen
+#define BYTES(x) ((x) * 0x0101010101010101ULL)
+
+static unsigned fw, fh;
+static uint64_t width_mask;
+
+static uint64_t load64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static void store64(uint8_t *p, uint64_t v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+static uint64_t dilate_h(uint64_t v)
+{
+    return v | ((v << 1) & BYTES(0xFE)) | ((v >> 1) & BYTES(0x7F));
+}
+
+// src hat vor und hinter den fh Zeilen je acht Nullbytes, dst ist auf ganze
+// Wörter aufgerundet
+static void transform_rows(enum style s, uint8_t *dst, const uint8_t *src, unsigned underline)
+{
+    switch (s)
+    {
+        case STYLE_BOLD:
+            for (unsigned y = 0; y < fh; y += 8)
+            {
+                uint64_t v = load64(src + y);
+                store64(dst + y, (v | ((v << 1) & BYTES(0xFE))) & width_mask);
+            }
+            break;
+
+        case STYLE_OUTLINE:
+            for (unsigned y = 0; y < fh; y += 8)
+            {
+                uint64_t v = load64(src + y);
+                uint64_t d = dilate_h(load64(src + y - 1)) | dilate_h(v) | dilate_h(load64(src + y + 1));
+                store64(dst + y, d & ~v & width_mask);
+            }
+            break;
+
+        case STYLE_UNDERLINE:
+            memcpy(dst, src, fh);
+            dst[underline] = width_mask;
+            break;
+
+        case STYLE_OBLIQUE:
+            // Oben weiter nach rechts, unten nach links; die Mitte bleibt
+            for (unsigned y = 0; y < fh; y++)
+            {
+                int shift = (int)(fh - 1 - y) / 4 - (int)(fh - 1) / 8;
+                unsigned r = src[y];
+                // Bei hohen Zeichen wird die Zeile ganz hinausgeschoben (und
+                // die Verschiebung darf die Breite von r nicht erreichen)
+                if ((shift >= 8) || (shift <= -8))
+                    dst[y] = 0;
+                else
+                    dst[y] = ((shift >= 0) ? r << shift : r >> -shift) & width_mask;
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void ink_bounds(struct npf_metrics *m, const uint8_t *rows)
+{
+    unsigned ink = 0;
+    int top = -1, bottom = -1;
+    for (unsigned y = 0; y < fh; y++)
+    {
+        if (rows[y])
+        {
+            if (top < 0)
+                top = y;
+            bottom = y;
+            ink |= rows[y];
+        }
+    }
+
+    m->ink_x = m->ink_y = m->ink_w = m->ink_h = 0;
+    if (ink)
+    {
+        m->ink_x = __builtin_ctz(ink);
+        m->ink_w = 32 - __builtin_clz(ink) - m->ink_x;
+        m->ink_y = top;
+        m->ink_h = bottom + 1 - top;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 4)
+    {
+        fprintf(stderr, "Benutzung: npfstyle <npf> [-b <npf>] [-i <npf>] [-o <npf>] [-u <npf>] [-l <Zeile>]\n");
+        fprintf(stderr, " -b: Fett\n");
+        fprintf(stderr, " -i: Schräg\n");
+        fprintf(stderr, " -o: Kontur\n");
+        fprintf(stderr, " -u: Unterstrichen\n");
+        fprintf(stderr, " -l: Zeile für die Unterstreichung (Standard: die unterste)\n");
+        return 1;
+    }
+
+    const char *out_name[STYLES] = { NULL };
+    long underline = -1;
+
+    for (int i = 2; i < argc; i += 2)
+    {
+        if (i + 1 >= argc)
+        {
+            fprintf(stderr, "Option %s erwartet einen Parameter.\n", argv[i]);
+            return 1;
+        }
+
+        if (!strcmp(argv[i], "-l"))
+        {
+            char *tmp;
+            underline = strtol(argv[i + 1], &tmp, 0);
+            if (*tmp || (underline < 0))
+            {
+                fprintf(stderr, "Ungültige Zeile.\n");
+                return 1;
+            }
+            continue;
+        }
+
+        int s;
+        for (s = 0; (s < STYLES) && strcmp(argv[i], style_option[s]); s++);
+
+        if (s >= STYLES)
+        {
+            fprintf(stderr, "Unbekannte Option „%s“.\n", argv[i]);
+            return 1;
+        }
+
+        out_name[s] = argv[i + 1];
+    }
+
+    FILE *in = fopen(argv[1], "rb");
+    if (in == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    fseek(in, 0, SEEK_END);
+    size_t filesz = ftell(in);
+    rewind(in);
+
+    if (filesz < sizeof(struct npf))
+    {
+        fprintf(stderr, "Datei ist zu klein.\n");
+        return 1;
+    }
+
+    struct npf *npfh = malloc(filesz);
+    fread(npfh, filesz, 1, in);
+    fclose(in);
+
+    if (strncmp(npfh->sig, "NPF", 3))
+    {
+        fprintf(stderr, "Keine NPF-Datei.\n");
+        return 1;
+    }
+
+    if ((npfh->version != '2') && (npfh->version != '3'))
+    {
+        fprintf(stderr, "Nicht unterstützte Version.\n");
+        return 1;
+    }
+
+    if (npfh->width > 8)
+    {
+        fprintf(stderr, "Schriftarten, die breiter als acht Pixel sind, werden nicht unterstützt.\n");
+        return 1;
+    }
+
+    fw = npfh->width;
+    fh = npfh->height;
+    width_mask = BYTES((1u << fw) - 1);
+
+    size_t metricsz = (npfh->version >= '3') ? sizeof(struct npf_metrics) : 0;
+    size_t charsz = fh + sizeof(uint32_t) + metricsz;
+
+    if ((filesz - sizeof(struct npf)) % charsz)
+    {
+        fprintf(stderr, "Ungültige Dateigröße (kein Vielfaches der Zeichengröße).\n");
+        return 1;
+    }
+
+    if (underline < 0)
+        underline = fh - 1;
+    else if (underline >= fh)
+    {
+        fprintf(stderr, "Die Schriftart ist nur %u Zeilen hoch.\n", fh);
+        return 1;
+    }
+
+    size_t chars = (filesz - sizeof(struct npf)) / charsz;
+
+    // Zeilen mit Nullen davor und danach, damit die Nachbarzeilen am Rand
+    // ohne Sonderfälle gelesen werden können
+    size_t words = (fh + 7) / 8 * 8;
+    uint8_t *pad = calloc(words + 16, 1), *src = pad + 8;
+    uint8_t *dst = malloc(words);
+
+    uint8_t *out = malloc(filesz);
+
+    for (int s = 0; s < STYLES; s++)
+    {
+        if (out_name[s] == NULL)
+            continue;
+
+        memcpy(out, npfh, filesz);
+
+        struct npf *outh = (struct npf *)out;
+        char name[25] = { 0 };
+        int len = 24;
+        while ((len > 0) && ((npfh->name[len - 1] == ' ') || !npfh->name[len - 1]))
+            len--;
+        snprintf(name, sizeof(name), "%.*s %s", len, npfh->name, style_name[s]);
+        memset(outh->name, ' ', 24);
+        memcpy(outh->name, name, strlen(name));
+
+        struct npf_char *c = (struct npf_char *)(outh + 1);
+        for (size_t ci = 0; ci < chars; ci++)
+        {
+            memcpy(src, c->rows, fh);
+            transform_rows(s, dst, src, underline);
+            memcpy(c->rows, dst, fh);
+
+            if (metricsz)
+                ink_bounds((struct npf_metrics *)&c->rows[fh], c->rows);
+
+            c = (struct npf_char *)((uintptr_t)c + charsz);
+        }
+
+        FILE *fp = fopen(out_name[s], "wb");
+        if (fp == NULL)
+        {
+            perror(out_name[s]);
+            return 1;
+        }
+
+        fwrite(out, filesz, 1, fp);
+        fclose(fp);
+
+        printf("„%s“ mit %zu Zeichen geschrieben.\n", name, chars);
+    }
+
+    free(out);
+    free(dst);
+    free(pad);
+    free(npfh);
+
+    return 0;
+}
@@ -0,0 +1,212 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stream.h"
+
+struct npf
+{
+    char sig[3], version;
+    uint16_t height, width;
+    char name[24];
+} __attribute__((packed));
+
+struct npf_char
+{
+    uint32_t num;
+    uint8_t rows[];
+} __attribute__((packed));
+
+struct psf2
+{
+    uint8_t magic[4];
+    uint32_t version, headersize, flags;
+    uint32_t length, charsize;
+    uint32_t height, width;
+} __attribute__((packed));
+
+#define PSF2_HAS_UNICODE_TABLE 0x01
+
+#define PSF2_SEPARATOR 0xFF
+#define PSF2_STARTSEQ  0xFE
+
+static const uint8_t psf2_magic[4] = { 0x72, 0xB5, 0x4A, 0x86 };
+
+// Liest ein UTF-8-Zeichen aus der Unicodetabelle; gibt (uint32_t)-1 bei
+// ungültigen Sequenzen zurück.
+static uint32_t read_utf8(const uint8_t **p, const uint8_t *end)
+{
+    uint8_t b = *(*p)++;
+    if (b < 0x80)
+        return b;
+
+    int len = (b >= 0xF0) ? 3 : (b >= 0xE0) ? 2 : (b >= 0xC0) ? 1 : -1;
+    if ((len < 0) || (end - *p < len))
+        return (uint32_t)-1;
+
+    uint32_t cp = b & (0x3F >> len);
+    while (len--)
+    {
+        if ((**p & 0xC0) != 0x80)
+            return (uint32_t)-1;
+        cp = (cp << 6) | (*(*p)++ & 0x3F);
+    }
+
+    return cp;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Benutzung: psf2npf <psf> <npf> [Name]\n");
+        fprintf(stderr, "„-“ steht für die Standardein- bzw. -ausgabe.\n");
+        return 1;
+    }
+
+    FILE *psf = stream_open(argv[1], "rb");
+    if (psf == NULL)
+        return 1;
+
+    size_t filesz;
+    uint8_t *data = stream_read_all(psf, &filesz);
+    if (data == NULL)
+    {
+        fprintf(stderr, "%s: Lesefehler.\n", argv[1]);
+        return 1;
+    }
+    fclose(psf);
+
+    if (filesz < sizeof(struct psf2))
+    {
+        fprintf(stderr, "Datei ist zu klein.\n");
+        return 1;
+    }
+
+    const struct psf2 *psfh = (const struct psf2 *)data;
+
+    if (memcmp(psfh->magic, psf2_magic, 4))
+    {
+        fprintf(stderr, "Keine PSF2-Datei.\n");
+        return 1;
+    }
+
+    if (psfh->version != 0)
+    {
+        fprintf(stderr, "Nicht unterstützte Version.\n");
+        return 1;
+    }
+
+    size_t rowsz = (psfh->width + 7) / 8;
+    if (!psfh->width || !psfh->height || (psfh->width > UINT16_MAX) || (psfh->height > UINT16_MAX) ||
+        (psfh->charsize != psfh->height * rowsz))
+    {
+        fprintf(stderr, "Ungültige Zeichengröße.\n");
+        return 1;
+    }
+
+    if ((psfh->headersize > filesz) || ((filesz - psfh->headersize) / psfh->charsize < psfh->length))
+    {
+        fprintf(stderr, "Datei ist zu klein.\n");
+        return 1;
+    }
+
+    FILE *npf = stream_open(argv[2], "wb");
+    if (npf == NULL)
+        return 1;
+
+    struct npf npfh = {
+        .sig = "NPF",
+        .version = '2',
+        .height = psfh->height,
+        .width = psfh->width
+    };
+
+    memset(npfh.name, ' ', 24);
+    if (argc > 3)
+        memcpy(npfh.name, argv[3], (strlen(argv[3]) > 24) ? 24 : strlen(argv[3]));
+
+    fwrite(&npfh, sizeof(npfh), 1, npf);
+
+    // PSF2 speichert das höchstwertige Bit links, NPF das niederwertigste
+    uint8_t bitrev[256];
+    for (unsigned i = 0; i < 256; i++)
+    {
+        bitrev[i] = 0;
+        for (unsigned j = 0; j < 8; j++)
+            if (i & (1 << j))
+                bitrev[i] |= 0x80 >> j;
+    }
+
+    // Glyphen vorab umwandeln, da sie mehrfach (für mehrere Codes) geschrieben
+    // werden können
+    size_t charsz = psfh->charsize + sizeof(uint32_t);
+    struct npf_char *glyphs = malloc(psfh->length * charsz);
+    const uint8_t *src = data + psfh->headersize;
+
+    for (uint32_t g = 0; g < psfh->length; g++)
+    {
+        struct npf_char *c = (struct npf_char *)((uintptr_t)glyphs + g * charsz);
+        c->num = g;
+        for (uint32_t i = 0; i < psfh->charsize; i++)
+            c->rows[i] = bitrev[src[i]];
+        src += psfh->charsize;
+    }
+
+    unsigned chars = 0;
+
+    if (!(psfh->flags & PSF2_HAS_UNICODE_TABLE))
+    {
+        fwrite(glyphs, charsz, psfh->length, npf);
+        chars = psfh->length;
+    }
+    else
+    {
+        const uint8_t *end = data + filesz;
+
+        for (uint32_t g = 0; (g < psfh->length) && (src < end); g++)
+        {
+            struct npf_char *c = (struct npf_char *)((uintptr_t)glyphs + g * charsz);
+
+            // Einzelne Codes bis zum ersten PSF2_STARTSEQ übernehmen, Sequenzen
+            // (kombinierende Zeichen) lassen sich in NPF nicht abbilden
+            bool in_seq = false;
+            while ((src < end) && (*src != PSF2_SEPARATOR))
+            {
+                if (*src == PSF2_STARTSEQ)
+                {
+                    in_seq = true;
+                    src++;
+                    continue;
+                }
+
+                uint32_t cp = read_utf8(&src, end);
+                if (cp == (uint32_t)-1)
+                {
+                    fprintf(stderr, "Ungültige Unicodetabelle (Zeichen %u).\n", (unsigned)g);
+                    fclose(npf);
+                    return 1;
+                }
+
+                if (!in_seq)
+                {
+                    c->num = cp;
+                    fwrite(c, charsz, 1, npf);
+                    chars++;
+                }
+            }
+
+            src++;
+        }
+    }
+
+    fprintf(stream_messages(npf), "Schriftart mit %u Zeichen (%u×%u) erstellt.\n", chars, (unsigned)psfh->width, (unsigned)psfh->height);
+
+    fclose(npf);
+    free(glyphs);
+    free(data);
+
+    return 0;
+}
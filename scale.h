@@ -0,0 +1,60 @@
+#ifndef SCALE_H
+#define SCALE_H
+
+#include <stdint.h>
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+// Ganzzahlige Skalierung (nächster Nachbar) von Glyphenzeilen: Jedes Bit eines
+// Bytes wird auf n nebeneinanderliegende Bits verteilt, sodass eine Zeile mit
+// einem Tabellenzugriff (bzw. PDEP) pro Byte skaliert wird.
+
+#define SCALE_MAX 4
+
+#ifndef __BMI2__
+static uint32_t scale_table[SCALE_MAX + 1][256];
+#endif
+
+static inline void scale_init(void)
+{
+#ifndef __BMI2__
+    for (unsigned n = 1; n <= SCALE_MAX; n++)
+    {
+        for (unsigned b = 0; b < 256; b++)
+        {
+            uint32_t v = 0;
+            for (unsigned i = 0; i < 8; i++)
+                if (b & (1 << i))
+                    v |= ((1u << n) - 1) << (i * n);
+            scale_table[n][b] = v;
+        }
+    }
+#endif
+}
+
+static inline uint32_t scale_byte(uint8_t b, unsigned n)
+{
+#ifdef __BMI2__
+    // Bits an jede n-te Stelle legen, dann per Multiplikation auf n Bits
+    // verbreitern (die Gruppen überlappen nicht, also gibt es keine Überträge)
+    static const uint32_t dep[SCALE_MAX + 1] = { 0, 0xFF, 0x5555, 0x249249, 0x11111111 };
+    return _pdep_u32(b, dep[n]) * ((1u << n) - 1);
+#else
+    return scale_table[n][b];
+#endif
+}
+
+// dst muss Platz für src_bytes * n Bytes haben.
+static inline void scale_row(uint8_t *dst, const uint8_t *src, unsigned src_bytes, unsigned n)
+{
+    for (unsigned i = 0; i < src_bytes; i++)
+    {
+        uint32_t v = scale_byte(src[i], n);
+        for (unsigned j = 0; j < n; j++)
+            dst[i * n + j] = v >> (j * 8);
+    }
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+// Ein- und Ausgabe für die Konverter: „-“ steht für stdin bzw. stdout, damit
+// sich Konvertierungen ohne temporäre Dateien verketten lassen. Eingaben
+// werden nicht per fseek()/ftell() vermessen, sondern in einen wachsenden
+// Puffer gelesen, das geht auch mit Pipes.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static inline bool stream_is_std(const char *name)
+{
+    return !strcmp(name, "-");
+}
+
+// mode wie bei fopen(); gibt bei einem Fehler NULL zurück (nach perror())
+static inline FILE *stream_open(const char *name, const char *mode)
+{
+    if (stream_is_std(name))
+        return (mode[0] == 'r') ? stdin : stdout;
+
+    FILE *fp = fopen(name, mode);
+    if (fp == NULL)
+        perror(name);
+    return fp;
+}
+
+// Meldungen dürfen nicht in den Datenstrom geraten
+static inline FILE *stream_messages(FILE *out)
+{
+    return (out == stdout) ? stderr : stdout;
+}
+
+// Liest fp vollständig; gibt den Puffer (mit malloc() angelegt) zurück und
+// seine Größe in *size, bei einem Lesefehler NULL
+static inline void *stream_read_all(FILE *fp, size_t *size)
+{
+    size_t cap = 65536, len = 0;
+    char *buf = malloc(cap);
+
+    for (;;)
+    {
+        len += fread(buf + len, 1, cap - len, fp);
+        if (len < cap)
+            break;
+
+        cap *= 2;
+        buf = realloc(buf, cap);
+    }
+
+    if (ferror(fp))
+    {
+        free(buf);
+        return NULL;
+    }
+
+    *size = len;
+    return buf;
+}
+
+#endif